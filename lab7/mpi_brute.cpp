@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <cmath>
 #include <random>
+#include <string>
+#include "poly_stream.hpp"
 
 std::vector<int> generateRandomVector(size_t size, int minValue = -10, int maxValue = 10) {
     std::random_device randomDevice;
@@ -29,6 +31,35 @@ int main(int argc, char* argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "generate" && argc >= 4) {
+        long long count = std::stoll(argv[3]);
+        bool ok = count >= 1;
+        if (rank == 0) {
+            if (!ok) std::cerr << "Coefficient count must be at least 1, got " << count << "\n";
+            else ok = writePolynomial(argv[2], generateRandomVector(count));
+        }
+        MPI_Bcast(&ok, 1, MPI_CXX_BOOL, 0, MPI_COMM_WORLD);
+        MPI_Finalize();
+        return ok ? 0 : 1;
+    }
+    if (mode == "stream" && argc >= 5) {
+        int block = argc > 5 ? std::stoi(argv[5]) : 4096;
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto streamStart = std::chrono::high_resolution_clock::now();
+        bool ok = multiplyStreaming(argv[2], argv[3], argv[4], block, rank, size, multiplyNaive);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!ok) {
+            MPI_Finalize();
+            return 1;
+        }
+        auto streamEnd = std::chrono::high_resolution_clock::now();
+        if (rank == 0)
+            std::cout << "MPI streaming time: " << std::chrono::duration<double>(streamEnd - streamStart).count() << " seconds\n";
+        MPI_Finalize();
+        return 0;
+    }
+
     int n = 10000;
     std::vector<int> A, B, C, naiveResult;
     double seqTime = 0.0, parTime = 0.0;
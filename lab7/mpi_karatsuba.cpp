@@ -3,7 +3,9 @@
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <string>
 #include "mpi.h"
+#include "poly_stream.hpp"
 
 // Function to generate a random integer vector
 std::vector<int> generate_random_vector(size_t size, int min_value = 0, int max_value = 100) {
@@ -41,10 +43,10 @@ std::vector<int> multiply_karatsuba(const std::vector<int>& vec_a, const std::ve
     auto low_result = multiply_karatsuba(vec_a_low, vec_b_low);
     auto high_result = multiply_karatsuba(vec_a_high, vec_b_high);
 
-    std::vector<int> vec_a_sum(vec_a_low.size(), 0), vec_b_sum(vec_b_low.size(), 0);
+    std::vector<int> vec_a_sum(vec_a_high), vec_b_sum(vec_b_high);
     for (int i = 0; i < mid; ++i) {
-        vec_a_sum[i] = vec_a_low[i] + vec_a_high[i];
-        vec_b_sum[i] = vec_b_low[i] + vec_b_high[i];
+        vec_a_sum[i] += vec_a_low[i];
+        vec_b_sum[i] += vec_b_low[i];
     }
 
     auto middle_result = multiply_karatsuba(vec_a_sum, vec_b_sum);
@@ -62,6 +64,17 @@ std::vector<int> multiply_karatsuba(const std::vector<int>& vec_a, const std::ve
     return result;
 }
 
+// Packs a child's task (data size, sub-tree size and both halves) into one message
+std::vector<int> pack_task(int data_size, int new_size, const std::vector<int>& vec_a, const std::vector<int>& vec_b) {
+    std::vector<int> task;
+    task.reserve(2 + 2 * data_size);
+    task.push_back(data_size);
+    task.push_back(new_size);
+    task.insert(task.end(), vec_a.begin(), vec_a.begin() + data_size);
+    task.insert(task.end(), vec_b.begin(), vec_b.begin() + data_size);
+    return task;
+}
+
 // Recursive Karatsuba multiplication using MPI
 void karatsuba_recursive_mpi(const std::vector<int>& vec_a, const std::vector<int>& vec_b,
                              int rank, int process_count, std::vector<int>& result) {
@@ -93,35 +106,30 @@ void karatsuba_recursive_mpi(const std::vector<int>& vec_a, const std::vector<in
     int size2 = (rank + process_count) - child2;
 
     if (process_count == 2) {
-        MPI_Send(&mid, 1, MPI_INT, child2, 0, MPI_COMM_WORLD);
-        int zero = 0;
-        MPI_Send(&zero, 1, MPI_INT, child2, 0, MPI_COMM_WORLD);
-        MPI_Send(vec_a_low.data(), mid, MPI_INT, child2, 0, MPI_COMM_WORLD);
-        MPI_Send(vec_b_low.data(), mid, MPI_INT, child2, 0, MPI_COMM_WORLD);
+        std::vector<int> task = pack_task(mid, 0, vec_a_low, vec_b_low);
+        MPI_Request requests[2];
+        MPI_Isend(task.data(), static_cast<int>(task.size()), MPI_INT, child2, 0, MPI_COMM_WORLD, &requests[0]);
+        MPI_Irecv(low_result.data(), static_cast<int>(low_result.size()), MPI_INT, child2, 0, MPI_COMM_WORLD,
+                  &requests[1]);
 
         high_result = multiply_karatsuba(vec_a_high, vec_b_high);
         middle_result = multiply_karatsuba(vec_a_sum, vec_b_sum);
 
-        MPI_Status status;
-        MPI_Recv(low_result.data(), static_cast<int>(low_result.size()), MPI_INT, child2, 0,
-                 MPI_COMM_WORLD, &status);
-    } else if (child1 < process_count && child2 < process_count) {
-        MPI_Send(&mid, 1, MPI_INT, child1, 0, MPI_COMM_WORLD);
-        MPI_Send(&mid_left, 1, MPI_INT, child2, 0, MPI_COMM_WORLD);
-        MPI_Send(&size1, 1, MPI_INT, child1, 0, MPI_COMM_WORLD);
-        MPI_Send(&size2, 1, MPI_INT, child2, 0, MPI_COMM_WORLD);
-
-        MPI_Send(vec_a_low.data(), mid, MPI_INT, child1, 0, MPI_COMM_WORLD);
-        MPI_Send(vec_b_low.data(), mid, MPI_INT, child1, 0, MPI_COMM_WORLD);
-
-        MPI_Send(vec_a_high.data(), mid_left, MPI_INT, child2, 0, MPI_COMM_WORLD);
-        MPI_Send(vec_b_high.data(), mid_left, MPI_INT, child2, 0, MPI_COMM_WORLD);
+        MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+    } else if (process_count >= 3) {
+        std::vector<int> task1 = pack_task(mid, size1, vec_a_low, vec_b_low);
+        std::vector<int> task2 = pack_task(mid_left, size2, vec_a_high, vec_b_high);
+        MPI_Request requests[4];
+        MPI_Isend(task1.data(), static_cast<int>(task1.size()), MPI_INT, child1, 0, MPI_COMM_WORLD, &requests[0]);
+        MPI_Isend(task2.data(), static_cast<int>(task2.size()), MPI_INT, child2, 0, MPI_COMM_WORLD, &requests[1]);
+        MPI_Irecv(low_result.data(), static_cast<int>(low_result.size()), MPI_INT, child1, 0, MPI_COMM_WORLD,
+                  &requests[2]);
+        MPI_Irecv(high_result.data(), static_cast<int>(high_result.size()), MPI_INT, child2, 0, MPI_COMM_WORLD,
+                  &requests[3]);
 
         middle_result = multiply_karatsuba(vec_a_sum, vec_b_sum);
 
-        MPI_Status status;
-        MPI_Recv(low_result.data(), static_cast<int>(low_result.size()), MPI_INT, child1, 0, MPI_COMM_WORLD, &status);
-        MPI_Recv(high_result.data(), static_cast<int>(high_result.size()), MPI_INT, child2, 0, MPI_COMM_WORLD, &status);
+        MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
     } else {
         low_result = multiply_karatsuba(vec_a_low, vec_b_low);
         high_result = multiply_karatsuba(vec_a_high, vec_b_high);
@@ -140,21 +148,26 @@ void karatsuba_recursive_mpi(const std::vector<int>& vec_a, const std::vector<in
 
 // MPI worker for Karatsuba multiplication
 void karatsuba_mpi_worker(int rank) {
-    MPI_Status status;
-    int data_size = 0, new_size = 0;
+    while (true) {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
+        int parent = status.MPI_SOURCE;
+        int task_size = 0;
+        MPI_Get_count(&status, MPI_INT, &task_size);
 
-    MPI_Recv(&data_size, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
-    int parent = status.MPI_SOURCE;
-    MPI_Recv(&new_size, 1, MPI_INT, parent, 0, MPI_COMM_WORLD, &status);
+        std::vector<int> task(task_size);
+        MPI_Recv(task.data(), task_size, MPI_INT, parent, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (task_size == 0) return; // empty message from the root: the computation is over
 
-    std::vector<int> vec_a(data_size), vec_b(data_size);
-    MPI_Recv(vec_a.data(), data_size, MPI_INT, parent, 0, MPI_COMM_WORLD, &status);
-    MPI_Recv(vec_b.data(), data_size, MPI_INT, parent, 0, MPI_COMM_WORLD, &status);
+        int data_size = task[0], new_size = task[1];
+        std::vector<int> vec_a(task.begin() + 2, task.begin() + 2 + data_size);
+        std::vector<int> vec_b(task.begin() + 2 + data_size, task.end());
 
-    std::vector<int> result(2 * data_size - 1, 0);
-    karatsuba_recursive_mpi(vec_a, vec_b, rank, new_size, result);
+        std::vector<int> result(2 * data_size - 1, 0);
+        karatsuba_recursive_mpi(vec_a, vec_b, rank, new_size, result);
 
-    MPI_Send(result.data(), static_cast<int>(result.size()), MPI_INT, parent, 0, MPI_COMM_WORLD);
+        MPI_Send(result.data(), static_cast<int>(result.size()), MPI_INT, parent, 0, MPI_COMM_WORLD);
+    }
 }
 
 int main(int argc, char** argv) {
@@ -164,6 +177,36 @@ int main(int argc, char** argv) {
     MPI_Comm_size(MPI_COMM_WORLD, &process_count);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "generate" && argc >= 4) {
+        long long count = std::stoll(argv[3]);
+        bool ok = count >= 1;
+        if (rank == 0) {
+            if (!ok) std::cerr << "Coefficient count must be at least 1, got " << count << "\n";
+            else ok = writePolynomial(argv[2], generate_random_vector(count));
+        }
+        MPI_Bcast(&ok, 1, MPI_CXX_BOOL, 0, MPI_COMM_WORLD);
+        MPI_Finalize();
+        return ok ? 0 : 1;
+    }
+    if (mode == "stream" && argc >= 5) {
+        int block = argc > 5 ? std::stoi(argv[5]) : 4096;
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto start_time = std::chrono::high_resolution_clock::now();
+        bool ok = multiplyStreaming(argv[2], argv[3], argv[4], block, rank, process_count, multiply_karatsuba);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!ok) {
+            MPI_Finalize();
+            return 1;
+        }
+        auto end_time = std::chrono::high_resolution_clock::now();
+        if (rank == 0)
+            std::cout << "MPI Streaming Karatsuba Time: "
+                      << std::chrono::duration<double>(end_time - start_time).count() << " seconds\n";
+        MPI_Finalize();
+        return 0;
+    }
+
     int data_size = 10000;
 
     if (rank == 0) {
@@ -184,6 +227,9 @@ int main(int argc, char** argv) {
                   << std::chrono::duration<double>(end_time - start_time).count() << " seconds\n";
 
         std::cout << "Results equal: " << std::boolalpha << (result == naive_result) << "\n";
+
+        for (int worker = 1; worker < process_count; ++worker)
+            MPI_Send(nullptr, 0, MPI_INT, worker, 0, MPI_COMM_WORLD);
     } else {
         karatsuba_mpi_worker(rank);
     }
@@ -0,0 +1,106 @@
+#pragma once
+#include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes `coefficients` as a raw binary int file, replacing any previous contents. Rank-local (MPI_COMM_SELF).
+inline bool writePolynomial(const char* path, const std::vector<int>& coefficients) {
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_SELF, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+    MPI_File_set_size(file, 0);
+    MPI_File_write_at(file, 0, coefficients.data(), (int)coefficients.size(), MPI_INT, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+    return true;
+}
+
+// Reads block `index` of a binary int file, zero-padding past the end of the polynomial.
+inline std::vector<int> readBlock(MPI_File file, long long length, long long index, int block) {
+    std::vector<int> data(block, 0);
+    long long first = index * block;
+    int count = (int)std::max(0LL, std::min((long long)block, length - first));
+    if (count > 0)
+        MPI_File_read_at(file, first * sizeof(int), data.data(), count, MPI_INT, MPI_STATUS_IGNORE);
+    return data;
+}
+
+// Opens a polynomial file and returns its coefficient count, or -1 (reported on rank 0) if it cannot be used.
+inline long long openPolynomial(const char* path, MPI_File& file, int rank) {
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if (rank == 0) std::cerr << "Cannot open " << path << "\n";
+        return -1;
+    }
+    MPI_Offset bytes;
+    MPI_File_get_size(file, &bytes);
+    if (bytes == 0 || bytes % sizeof(int) != 0) {
+        if (rank == 0)
+            std::cerr << path << " must hold at least one int coefficient, got " << bytes << " bytes\n";
+        MPI_File_close(&file);
+        return -1;
+    }
+    return bytes / sizeof(int);
+}
+
+// Streams A and B from disk and writes C = A * B, keeping only O(block) coefficients per rank in memory.
+// `multiply(a, b)` returns the full product of two equal-length blocks (2 * block - 1 coefficients or more).
+// Output blocks are split between ranks; block k of C is the overlap-add of A_i * B_j for i + j = k
+// plus the upper half carried over from k - 1, which each rank recomputes for its first block.
+// Collective; returns false on every rank, without touching C, if block < 1 or an input is empty or unreadable.
+template <typename Multiply>
+bool multiplyStreaming(const char* pathA, const char* pathB, const char* pathC, int block, int rank, int size,
+                       Multiply multiply) {
+    if (block < 1) {
+        if (rank == 0) std::cerr << "Block size must be at least 1, got " << block << "\n";
+        return false;
+    }
+    MPI_File fileA, fileB, fileC;
+    long long lengthA = openPolynomial(pathA, fileA, rank);
+    if (lengthA < 0) return false;
+    long long lengthB = openPolynomial(pathB, fileB, rank);
+    if (lengthB < 0) {
+        MPI_File_close(&fileA);
+        return false;
+    }
+    if (MPI_File_open(MPI_COMM_WORLD, pathC, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fileC) != MPI_SUCCESS) {
+        if (rank == 0) std::cerr << "Cannot open " << pathC << " for writing\n";
+        MPI_File_close(&fileA);
+        MPI_File_close(&fileB);
+        return false;
+    }
+    long long lengthC = lengthA + lengthB - 1;
+    MPI_File_set_size(fileC, lengthC * sizeof(int));
+
+    long long blocksA = (lengthA + block - 1) / block;
+    long long blocksB = (lengthB + block - 1) / block;
+    long long blocksC = blocksA + blocksB;
+    long long chunk = (blocksC + size - 1) / size;
+    long long first = std::min(blocksC, rank * chunk);
+    long long last = std::min(blocksC, first + chunk);
+
+    std::vector<int> carry(block, 0);
+    for (long long k = std::max(0LL, first - 1); k < last; ++k) {
+        std::vector<int> window(2 * block, 0);
+        std::copy(carry.begin(), carry.end(), window.begin());
+        for (long long i = std::max(0LL, k - blocksB + 1); i <= std::min(k, blocksA - 1); ++i) {
+            std::vector<int> partial = multiply(readBlock(fileA, lengthA, i, block),
+                                                readBlock(fileB, lengthB, k - i, block));
+            for (size_t t = 0; t < partial.size() && t < window.size(); ++t)
+                window[t] += partial[t];
+        }
+        if (k >= first) {
+            int count = (int)std::max(0LL, std::min((long long)block, lengthC - k * block));
+            if (count > 0)
+                MPI_File_write_at(fileC, k * block * sizeof(int), window.data(), count, MPI_INT, MPI_STATUS_IGNORE);
+        }
+        std::copy(window.begin() + block, window.end(), carry.begin());
+    }
+
+    MPI_File_close(&fileA);
+    MPI_File_close(&fileB);
+    MPI_File_close(&fileC);
+    return true;
+}
@@ -3,27 +3,69 @@
 #include <mutex>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <array>
 #include <set>
 #include <sstream>
 #include <cstring>
+#include <memory>
+#include <cstdint>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <functional>
 #include <algorithm>
 #include <queue>
 #include <tuple>
 #include <condition_variable>
+#include <random>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <csignal>
+#include <ifaddrs.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 struct Variable {
     int value;                
     bool owned;              
+    int owner;
     std::set<int> subscribers; 
+    std::map<int, long long> leases;    // owner only: read-cache holder -> lease expiry (steady clock, us)
+    int version = 0;                    // clock of the newest SET or MIGRATE applied; older SETs are dropped
+    int ownerVersion = 0;               // clock of the newest ownership change seen
+    std::map<int, int> writeCounts;     // owner only: writes per origin in the current window
+    int windowWrites = 0;
+};
+
+enum MsgType : uint8_t {
+    MSG_SETREQ = 1, MSG_CMPXCHGREQ = 2, MSG_SET = 3, MSG_RESULT = 4,
+    MSG_SUBSCRIBE = 5, MSG_UNSUBSCRIBE = 6, MSG_MIGRATE = 7, MSG_OWNER = 8,
+    MSG_ATTACH = 9,     // first frame on a connection whose traffic moves to a shared-memory ring
+    MSG_CATCHUP = 10
 };
 
 struct Message {
     int clock;          
     int senderId;      
-    std::string content; 
+    MsgType type;
+    int varId;
+    int arg1;           // SET/SETREQ: value, CMPXCHGREQ: expected value, RESULT: 1 on success,
+                        // SUBSCRIBE: lease in ms, or 0 for a full subscription, CATCHUP: version held
+    int arg2;           // CMPXCHGREQ: new value, RESULT: owner's value after the request
+    int origin;         // requests and RESULT: node that issued the request
+    int reqId;          // 0 when the origin does not wait for a RESULT
+    int hops = 0;       // requests: times the request was sent on its way to the owner
+    std::vector<int> extra;  // MIGRATE: subscriber count, subscribers, lease count, (node, ms left) pairs
+    long long enqueuedNs = 0;   // local only: when the message entered the priority queue
 
     bool operator<(const Message& other) const {
         if (clock != other.clock)
@@ -32,29 +74,583 @@ struct Message {
     }
 };
 
+// Wire format: every frame is a 4-byte big-endian payload length followed by the payload,
+// which is the message type byte, eight big-endian int32 fields and any `extra` ints.
+const size_t FRAME_HEADER = 4;
+const size_t FRAME_PAYLOAD = 1 + 8 * 4;
+
+static void putInt(std::string &out, int v) {
+    uint32_t n = htonl((uint32_t)v);
+    out.append((const char*)&n, 4);
+}
+
+static int getInt(const char *p) {
+    uint32_t n;
+    memcpy(&n, p, 4);
+    return (int)ntohl(n);
+}
+
+static void encodeFrame(std::string &out, const Message &msg) {
+    putInt(out, (int)(FRAME_PAYLOAD + 4 * msg.extra.size()));
+    out.push_back((char)msg.type);
+    putInt(out, msg.clock);
+    putInt(out, msg.senderId);
+    putInt(out, msg.varId);
+    putInt(out, msg.arg1);
+    putInt(out, msg.arg2);
+    putInt(out, msg.origin);
+    putInt(out, msg.reqId);
+    putInt(out, msg.hops);
+    for (int v : msg.extra) putInt(out, v);
+}
+
+// Decodes one payload; returns false for unknown or short frames.
+static bool decodeFrame(const char *p, size_t len, Message &msg) {
+    if (len < FRAME_PAYLOAD) return false;
+    uint8_t type = (uint8_t)p[0];
+    if (type < MSG_SETREQ || type > MSG_CATCHUP) return false;
+    msg.type = (MsgType)type;
+    msg.clock = getInt(p + 1);
+    msg.senderId = getInt(p + 5);
+    msg.varId = getInt(p + 9);
+    msg.arg1 = getInt(p + 13);
+    msg.arg2 = getInt(p + 17);
+    msg.origin = getInt(p + 21);
+    msg.reqId = getInt(p + 25);
+    msg.hops = getInt(p + 29);
+    msg.extra.clear();
+    for (size_t off = FRAME_PAYLOAD; off + 4 <= len; off += 4) msg.extra.push_back(getInt(p + off));
+    return true;
+}
+
+// Per-message tracing on stdout. The benchmark turns it off at run time; building with
+// -DDSM_NO_TRACE removes it altogether.
+static bool verbose = true;
+
+#ifdef DSM_NO_TRACE
+#define TRACE(expr) do {} while (0)
+#else
+#define TRACE(expr) do { if (verbose) std::cout << expr; } while (0)
+
+static std::string describe(const Message &msg) {
+    static const char *names[] = {"?", "SETREQ", "CMPXCHGREQ", "SET", "RESULT", "SUBSCRIBE", "UNSUBSCRIBE", "MIGRATE", "OWNER", "ATTACH", "CATCHUP"};
+    std::ostringstream oss;
+    oss << "LC " << msg.clock << " " << msg.senderId << " " << names[msg.type] << " " << msg.varId << " " << msg.arg1;
+    if (msg.type == MSG_CMPXCHGREQ) oss << " " << msg.arg2;
+    if (msg.reqId) oss << " #" << msg.origin << ":" << msg.reqId;
+    return oss.str();
+}
+#endif
+
+static bool sendAll(int s, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(s, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Carries the encoded frame stream to one peer. Only the peer's current flusher calls
+// send, so implementations need no locking of their own.
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual bool send(const char *data, size_t len) = 0;
+};
+
+class TcpTransport : public Transport {
+    int fd;
+public:
+    explicit TcpTransport(int s) : fd(s) {}
+    ~TcpTransport() { close(fd); }
+    bool send(const char *data, size_t len) override { return sendAll(fd, data, len); }
+};
+
+static long long nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Single-producer, single-consumer byte ring in a POSIX shared-memory segment, used
+// between nodes on the same host. head and tail count bytes ever written and read.
+// A reader that finds the ring empty spins briefly, then sets `sleeping` and waits on
+// `bell`, which the writer bumps and futex-wakes only while someone sleeps. On a single
+// CPU the writer cannot run while the reader spins, so the reader goes straight to sleep.
+const size_t SHM_RING_BYTES = 1 << 20;
+const int SHM_SPIN = 4096;
+
+struct ShmRing {
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> bell;
+    std::atomic<uint32_t> sleeping;
+    std::atomic<uint32_t> closed;     // set by either side when it goes away
+    std::atomic<long long> publishedNs;   // steady clock of the last publish into an empty ring, for ring_wait_ns
+    char data[SHM_RING_BYTES];
+};
+
+static std::string shmRingName(int receiverPort, int senderId) {
+    return "/dsm-" + std::to_string(receiverPort) + "-" + std::to_string(senderId);
+}
+
+static ShmRing *mapRing(const std::string &name, bool create) {
+    if (create) shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+    if (create && ftruncate(fd, sizeof(ShmRing)) < 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    void *p = mmap(nullptr, sizeof(ShmRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? nullptr : (ShmRing*)p;
+}
+
+static void ringWake(ShmRing *ring) {
+    if (ring->sleeping.load()) {
+        ring->bell.fetch_add(1);
+        syscall(SYS_futex, (uint32_t*)&ring->bell, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+}
+
+class ShmTransport : public Transport {
+    ShmRing *ring;
+    std::string name;
+    int fd;                       // connection that carried MSG_ATTACH, kept open for the ring's lifetime
+public:
+    ShmTransport(ShmRing *r, const std::string &n, int s) : ring(r), name(n), fd(s) {}
+    ~ShmTransport() {
+        ring->closed.store(1);
+        ring->sleeping.store(1);
+        ringWake(ring);
+        munmap(ring, sizeof(ShmRing));
+        shm_unlink(name.c_str());
+        close(fd);
+    }
+
+    // Blocks while the ring is full; fails once the reader has gone away.
+    bool send(const char *data, size_t len) override {
+        while (len > 0) {
+            if (ring->closed.load()) return false;
+            uint64_t head = ring->head.load(std::memory_order_relaxed);
+            size_t room = SHM_RING_BYTES - (size_t)(head - ring->tail.load(std::memory_order_acquire));
+            if (room == 0) {
+                char c;
+                if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) return false;   // reader's process is gone
+                std::this_thread::yield();
+                continue;
+            }
+            size_t n = std::min(len, room);
+            size_t off = head % SHM_RING_BYTES;
+            size_t first = std::min(n, SHM_RING_BYTES - off);
+            memcpy(ring->data + off, data, first);
+            memcpy(ring->data, data + first, n - first);
+            if (room == SHM_RING_BYTES) ring->publishedNs.store(nowNs(), std::memory_order_relaxed);
+            ring->head.store(head + n);
+            ringWake(ring);
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+};
+
+// True for loopback and for addresses of this host's own interfaces.
+static bool isLocalAddress(const in_addr &addr) {
+    if ((ntohl(addr.s_addr) >> 24) == 127) return true;
+    ifaddrs *list;
+    if (getifaddrs(&list) < 0) return false;
+    bool local = false;
+    for (ifaddrs *ifa = list; ifa && !local; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET)
+            local = ((sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr == addr.s_addr;
+    }
+    freeifaddrs(list);
+    return local;
+}
+
+// One long-lived outbound transport per peer. Frames are appended to `pending`;
+// whichever sender finds no flush in progress becomes the flusher and writes
+// everything queued so far in a single send, so concurrent messages to the same
+// peer are coalesced instead of paying one syscall each.
+struct Peer {
+    int id;
+    sockaddr_in addr;
+    std::unique_ptr<Transport> transport;   // only touched by the current flusher
+    std::mutex pendingMutex;
+    std::string pending;
+    bool flushing = false;
+};
+
+// Variables are spread over shards by id, each with its own lock, so operations on
+// unrelated variables never contend.
+const int SHARD_COUNT = 16;
+
+struct Shard {
+    std::mutex m;
+    std::unordered_map<int, Variable> variables;
+};
+
+// Variables with ids below DENSE_VARS also have a slot in a flat array that readVar
+// loads without locking. A slot packs the value in its low 32 bits and sets
+// SLOT_PRESENT while the node holds the variable, so one atomic load answers both.
+// Slots of variables read through a lease carry SLOT_CACHED instead and are valid
+// until leaseUntil[varId].
+const int DENSE_VARS = 1 << 16;
+const uint64_t SLOT_PRESENT = 1ULL << 32;
+const uint64_t SLOT_CACHED = 1ULL << 33;
+
+static long long nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readFile(const std::string &path, std::string &out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) out.append(chunk, n);
+    close(fd);
+    return n == 0;
+}
+
+// Durable state: `snapshot` holds a magic number, the Lamport clock, a record count and
+// SNAPSHOT_RECORD ints per variable; `wal` holds WAL_RECORD ints per applied change,
+// the snapshot fields plus the clock at the time. Both are big-endian like frames.
+const int SNAPSHOT_MAGIC = 0x44534d53;
+const int SNAPSHOT_RECORD = 5;     // varId, value, version, owner, ownerVersion
+const int WAL_RECORD = 6;
+const long long SNAPSHOT_EVERY = 4 << 20;   // WAL bytes that trigger a snapshot
+
+// Log-linear histogram in the style of HdrHistogram: a value is bucketed by its highest
+// set bit and the HIST_SUB_BITS bits below it, so every bucket is within 1/16 of its
+// values across the whole 64-bit range. Only the owning thread records; readers merge
+// with relaxed loads, so a dump may miss the very latest samples but never blocks.
+const int HIST_SUB_BITS = 4;
+const int HIST_SUB = 1 << HIST_SUB_BITS;
+const int HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) * HIST_SUB;
+
+struct Histogram {
+    std::atomic<uint64_t> counts[HIST_BUCKETS] = {};
+
+    static int bucketOf(uint64_t v) {
+        if (v < (uint64_t)HIST_SUB) return (int)v;
+        int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+        return (shift + 1) * HIST_SUB + (int)((v >> shift) & (HIST_SUB - 1));
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < HIST_SUB) return bucket;
+        int shift = bucket / HIST_SUB - 1;
+        return (uint64_t)(HIST_SUB + bucket % HIST_SUB) << shift;
+    }
+
+    void record(long long v) {
+        auto &c = counts[bucketOf(v < 0 ? 0 : (uint64_t)v)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+enum Counter { CNT_RECEIVED, CNT_APPLIED, CNT_FRAMES, CNT_BYTES, CNT_FLUSHES, CNT_FORWARDED, CNT_DIRECT, CNT_COUNT };
+enum Metric { MET_APPLY_NS, MET_QUEUE_DEPTH, MET_SEND_NS, MET_HOPS, MET_RING_NS, MET_COUNT };
+
+static const char *counterNames[CNT_COUNT] = {"received", "applied", "frames_sent", "bytes_sent", "flushes", "forwarded",
+                                              "applied_from_ring"};
+static const char *metricNames[MET_COUNT] = {"enqueue_to_apply_ns", "queue_depth", "send_ns", "forward_hops", "ring_wait_ns"};
+
+// Lower bound of the bucket holding the `rank` quantile (0..1] of a merged histogram.
+static uint64_t histogramPercentile(const uint64_t *h, double rank) {
+    uint64_t total = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) total += h[b];
+    uint64_t want = std::max<uint64_t>(1, (uint64_t)(rank * total + 0.5)), seen = 0;
+    int b = 0;
+    while (b < HIST_BUCKETS - 1 && seen + h[b] < want) seen += h[b++];
+    return Histogram::lowerBound(b);
+}
+
+struct ThreadStats {
+    std::atomic<uint64_t> counters[CNT_COUNT] = {};
+    Histogram metrics[MET_COUNT];
+
+    void count(Counter c, uint64_t n = 1) {
+        counters[c].store(counters[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+static std::atomic<uint64_t> nextInstance(0);
+
 class DsmNode {
     int nodeId;               
     int port;                 
     int sockfd;              
-    int lamportClock;        
-    std::map<int, Variable> variables;     
-    std::map<int, sockaddr_in> peers;        
+    std::atomic<int> lamportClock;
+    std::array<Shard, SHARD_COUNT> shards;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    std::unique_ptr<std::atomic<long long>[]> leaseUntil;
+    std::unordered_map<int, int> directory;  // configured owner of every variable, fixed after construction
+    std::map<int, std::unique_ptr<Peer>> peers;
+    std::mutex peersMutex;
     std::function<void(int,int)> onChange;  
-    std::mutex m;                            
-    bool running;                           
+    std::atomic<bool> running;
+    int epollFd;
+    int wakeFd;                              // eventfd that wakes the reactor on stop()
     std::thread serverThread;                
+    std::map<int, std::string> inbound;      // receive buffer per inbound connection, reactor thread only
+    // Metrics: every thread that works for this node records into its own ThreadStats,
+    // found through a thread-local cache, so the hot paths never share a cache line.
+    const uint64_t instance = ++nextInstance;
+    std::vector<std::unique_ptr<ThreadStats>> threadStats;
+    std::mutex statsMutex;
+    std::thread statsThread;
+    std::mutex statsWaitMutex;
+    std::condition_variable statsCv;
+    bool statsRunning = false;
+
+    // Each thread registers once per node; `registered` maps instance ids, which are
+    // never reused, to that thread's block, and the last one used is checked first.
+    ThreadStats &localStats() {
+        static thread_local uint64_t cachedInstance = 0;
+        static thread_local ThreadStats *cached = nullptr;
+        static thread_local std::unordered_map<uint64_t, ThreadStats*> registered;
+        if (cachedInstance == instance) return *cached;
+        ThreadStats *&st = registered[instance];
+        if (!st) {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            threadStats.emplace_back(new ThreadStats());
+            st = threadStats.back().get();
+        }
+        cachedInstance = instance;
+        cached = st;
+        return *cached;
+    }
+
+    // Hop count of the request being handled on this thread; 0 for requests issued here.
+    static int &requestHops() {
+        static thread_local int hops = 0;
+        return hops;
+    }
+
+    Message forwarded(Message msg) {
+        msg.hops = requestHops() + 1;
+        localStats().count(CNT_FORWARDED);
+        return msg;
+    }
+
+    void dumpStatsPeriodically(std::chrono::milliseconds interval) {
+        std::unique_lock<std::mutex> lock(statsWaitMutex);
+        while (!statsCv.wait_for(lock, interval, [this]() { return !statsRunning; }))
+            printStats(std::cerr);
+    }
+    bool sharedMemory = true;                // use rings for peers on this host
+    std::vector<std::thread> ringReaders;    // one per attached inbound ring
+    std::mutex ringMutex;
 
 
-    void incrementClock() {
-        lamportClock++;
+    int incrementClock() {
+        return ++lamportClock;
     }
 
     void updateClock(int incoming) {
-        lamportClock = std::max(lamportClock, incoming) + 1;
+        int cur = lamportClock.load();
+        while (!lamportClock.compare_exchange_weak(cur, std::max(cur, incoming) + 1)) {}
+    }
+
+    Shard &shardOf(int varId) {
+        return shards[(unsigned)varId % SHARD_COUNT];
+    }
+
+    // Called with the shard lock held, after the variable's value changed.
+    void publish(int varId, int val) {
+        if ((unsigned)varId < (unsigned)DENSE_VARS)
+            slots[varId].store(SLOT_PRESENT | (uint32_t)val, std::memory_order_release);
+    }
+
+    // Processing thread only: stores a leased value, or refreshes it when the owner's SET arrives.
+    void cacheValue(int varId, int val, long long until) {
+        if ((unsigned)varId >= (unsigned)DENSE_VARS) return;
+        if (until) leaseUntil[varId].store(until, std::memory_order_relaxed);
+        uint64_t slot = slots[varId].load(std::memory_order_relaxed);
+        if (until || (slot & SLOT_CACHED))
+            slots[varId].store(SLOT_CACHED | (uint32_t)val, std::memory_order_release);
+    }
+
+    // Write-ahead log. Every applied change is appended to walBuffer under walMutex; the
+    // logger thread writes and fsyncs whatever accumulated during the previous fsync as
+    // one group, and replaces the log with a snapshot once it passes SNAPSHOT_EVERY.
+    std::string logDir;
+    std::atomic<bool> logging{false};
+    int walFd = -1;
+    std::string walBuffer;
+    std::mutex walMutex;
+    std::condition_variable walCv;
+    std::condition_variable durableCv;
+    bool loggerRunning = false;
+    long long walAppended = 0, walDurable = 0;   // records, guarded by walMutex
+    bool walFailed = false;                       // guarded by walMutex; nothing is logged after the first error
+    long long walBytes = 0;                       // logger thread only
+    std::thread loggerThread;
+
+    // Called with the shard lock held, after any change to what a snapshot stores.
+    void logVar(int varId, const Variable &var) {
+        if (!logging.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(walMutex);
+        if (walFailed) return;
+        putInt(walBuffer, varId);
+        putInt(walBuffer, var.value);
+        putInt(walBuffer, var.version);
+        putInt(walBuffer, var.owner);
+        putInt(walBuffer, var.ownerVersion);
+        putInt(walBuffer, lamportClock.load(std::memory_order_relaxed));
+        walAppended++;
+        walCv.notify_one();
+    }
+
+    void writeLog() {
+        std::unique_lock<std::mutex> lock(walMutex);
+        while (true) {
+            walCv.wait(lock, [this]() { return !walBuffer.empty() || !loggerRunning; });
+            if (walBuffer.empty()) return;
+            std::string batch;
+            batch.swap(walBuffer);
+            long long upto = walAppended;
+            lock.unlock();
+            if (!writeAll(walFd, batch.data(), batch.size()) || fdatasync(walFd) < 0) {
+                std::cerr << "Error writing log in " << logDir << ", logging stopped\n";
+                lock.lock();
+                walFailed = true;
+                logging = false;
+                walBuffer.clear();
+                durableCv.notify_all();
+                return;
+            }
+            walBytes += batch.size();
+            if (walBytes >= SNAPSHOT_EVERY) writeSnapshot();
+            lock.lock();
+            walDurable = upto;
+            durableCv.notify_all();
+        }
+    }
+
+    // Logger thread only. Everything already in the log was applied before the shards are
+    // read, so the snapshot covers it and the log can be emptied; changes logged meanwhile
+    // are still in walBuffer and replay on top, guarded by their versions.
+    void writeSnapshot() {
+        std::string data;
+        putInt(data, SNAPSHOT_MAGIC);
+        putInt(data, lamportClock.load());
+        std::string records;
+        int count = 0;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.m);
+            for (auto &kv : shard.variables) {
+                putInt(records, kv.first);
+                putInt(records, kv.second.value);
+                putInt(records, kv.second.version);
+                putInt(records, kv.second.owner);
+                putInt(records, kv.second.ownerVersion);
+                count++;
+            }
+        }
+        putInt(data, count);
+        data += records;
+        std::string tmp = logDir + "/snapshot.tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && writeAll(fd, data.data(), data.size()) && fsync(fd) == 0;
+        if (fd >= 0) close(fd);
+        if (!ok || rename(tmp.c_str(), (logDir + "/snapshot").c_str()) < 0) {
+            std::cerr << "Error writing snapshot in " << logDir << "\n";
+            return;
+        }
+        int dirFd = open(logDir.c_str(), O_RDONLY);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+        if (ftruncate(walFd, 0) == 0) walBytes = 0;
+    }
+
+    // Restores a held variable from a snapshot or log record unless it already has newer state.
+    void restoreVar(const char *p, int &maxClock) {
+        int varId = getInt(p), version = getInt(p + 8), owner = getInt(p + 12), ownerVersion = getInt(p + 16);
+        maxClock = std::max(maxClock, std::max(version, ownerVersion));
+        Shard &shard = shardOf(varId);
+        std::lock_guard<std::mutex> lock(shard.m);
+        auto it = shard.variables.find(varId);
+        if (it == shard.variables.end()) return;
+        Variable &var = it->second;
+        if (version > var.version) {
+            var.value = getInt(p + 4);
+            var.version = version;
+            publish(varId, var.value);
+        }
+        if (ownerVersion > var.ownerVersion) {
+            var.owner = owner;
+            var.owned = owner == nodeId;
+            var.ownerVersion = ownerVersion;
+        }
+    }
+
+    // Work deferred until the shard lock is released: peers whose queued frames still
+    // have to be written, and outcomes of this node's own requests. Frames are queued
+    // while the lock is held, which keeps per-peer order equal to apply order.
+    // Outcome of a request as reported by the owner: its value of the variable afterwards
+    // and, for subscriptions, the owner and the versions the subscriber starts from.
+    struct Reply {
+        bool ok;
+        int value;
+        int owner = -1;
+        int version = 0;
+        int ownerVersion = 0;
+    };
+
+    struct Outbox {
+        std::vector<Peer*> peers;
+        std::vector<std::pair<int, Reply>> results;
+    };
+
+    // Requests waiting for a RESULT from the owner, by request id.
+    typedef std::function<void(const Reply&)> Completion;
+    std::atomic<int> nextRequestId;
+    std::unordered_map<int, Completion> inflight;
+    std::mutex inflightMutex;
+
+    int registerRequest(const Completion &done) {
+        int reqId = ++nextRequestId;
+        std::lock_guard<std::mutex> lock(inflightMutex);
+        inflight[reqId] = done;
+        return reqId;
+    }
+
+    void completeRequest(int reqId, const Reply &reply) {
+        Completion done;
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex);
+            auto it = inflight.find(reqId);
+            if (it == inflight.end()) return;
+            done = std::move(it->second);
+            inflight.erase(it);
+        }
+        if (done) done(reply);
     }
 
 
     std::priority_queue<Message> messageQueue;
+    std::atomic<int> queuedMessages;        // enqueued and not yet fully handled
 
     std::mutex queueMutex;
     std::condition_variable cv;
@@ -63,55 +659,198 @@ class DsmNode {
 
     bool processingRunning;
 
+    // SET coalescing: with a non-zero flushWindow, broadcasts are parked per peer and
+    // variable (a newer SET replaces the parked one) and sent by flusherThread.
+    std::atomic<long long> flushWindowUs;
+    std::map<int, std::map<int, Message>> pendingSets;
+    std::mutex setsMutex;
+    std::condition_variable setsCv;
+    bool flusherRunning;
+    std::thread flusherThread;
+
+    void flushSets() {
+        std::unique_lock<std::mutex> lock(setsMutex);
+        while (true) {
+            setsCv.wait(lock, [this]() { return !pendingSets.empty() || !flusherRunning; });
+            if (flusherRunning) {
+                setsCv.wait_for(lock, std::chrono::microseconds(flushWindowUs.load()), [this]() { return !flusherRunning; });
+            }
+            std::map<int, std::map<int, Message>> batch;
+            batch.swap(pendingSets);
+            bool last = !flusherRunning;
+            lock.unlock();
+            Outbox out;
+            for (auto &peerSets : batch) {
+                for (auto &kv : peerSets.second) post(peerSets.first, kv.second, out);
+            }
+            flush(out);
+            lock.lock();
+            if (last && pendingSets.empty()) return;
+        }
+    }
+
+    // Single epoll reactor for the listening socket and every inbound peer connection.
+    // Sockets are non-blocking and level-triggered; each readable connection is drained
+    // into its buffer and all complete frames are enqueued, so the node runs one I/O
+    // thread no matter how many peers or messages there are.
     void serverLoop() {
-        listen(sockfd, 10);  
+        listen(sockfd, 64);
+        epoll_event events[64];
         while (running) {
-            sockaddr_in client;
-            socklen_t len = sizeof(client);
-            int clientSock = accept(sockfd, (sockaddr*)&client, &len);
-            if (clientSock < 0) continue;
-            std::thread(&DsmNode::handleClient, this, clientSock).detach();
+            int n = epoll_wait(epollFd, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "epoll_wait failed\n";
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd) continue;
+                if (fd == sockfd) acceptClients();
+                else readClient(fd);
+            }
         }
+        for (auto &kv : inbound) close(kv.first);
+        inbound.clear();
     }
 
-    void handleClient(int clientSock) {
-        char buf[1024];
+    void watch(int fd) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void acceptClients() {
         while (true) {
-            int bytes = recv(clientSock, buf, 1024, 0);
-            if (bytes <= 0) break;
-            buf[bytes] = 0;
-            std::cout << "Node " << nodeId << " received: " << buf << "\n";
+            int clientSock = accept4(sockfd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (clientSock < 0) return;
+            inbound[clientSock];
+            watch(clientSock);
+        }
+    }
+
+    void readClient(int clientSock) {
+        std::string &buf = inbound[clientSock];
+        char chunk[16384];
+        while (true) {
+            ssize_t bytes = recv(clientSock, chunk, sizeof(chunk), 0);
+            if (bytes > 0) {
+                buf.append(chunk, bytes);
+                continue;
+            }
+            if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (bytes < 0 && errno == EINTR) continue;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSock, nullptr);
+            close(clientSock);
+            inbound.erase(clientSock);
+            return;
+        }
 
-            std::istringstream iss(buf);
-            std::string header, cmd;
-            int msgClock, senderId;
-            iss >> header >> msgClock >> senderId >> cmd;
-            if (header != "LC") continue; /
-           
-            std::string args;
-            std::getline(iss, args);
-            if (!args.empty() && args[0] == ' ')
-                args.erase(0, 1);
+        deliverFrames(buf);
+    }
 
-            enqueueMessage(msgClock, senderId, cmd, args);
+    // Enqueues every complete frame in `buf` and drops it from the buffer. Frames read from
+    // `ring` may instead be applied on the spot; see applyFromRing.
+    void deliverFrames(std::string &buf, ShmRing *ring = nullptr) {
+        size_t pos = 0;
+        while (buf.size() - pos >= FRAME_HEADER) {
+            size_t len = (size_t)getInt(buf.data() + pos);
+            if (buf.size() - pos - FRAME_HEADER < len) break;
+            Message msg;
+            if (decodeFrame(buf.data() + pos + FRAME_HEADER, len, msg)) {
+                TRACE("Node " << nodeId << " received: " << describe(msg) << "\n");
+                bool last = buf.size() - pos - FRAME_HEADER == len;
+                if (msg.type == MSG_ATTACH) attachRing(msg.senderId);
+                else if (!(ring && last && applyFromRing(msg, ring))) enqueueMessage(msg);
+            }
+            pos += FRAME_HEADER + len;
         }
-        close(clientSock);
+        buf.erase(0, pos);
     }
 
-    void enqueueMessage(int msgClock, int senderId, const std::string& cmd, const std::string& args) {
-        Message msg;
-        msg.clock = msgClock;
-        msg.senderId = senderId;
-        msg.content = cmd + " " + args;
+    // A SET read from a ring goes straight to handleMessageContent on the reader's thread, so
+    // the update costs one hand-off (writer to reader) instead of three. Only when that cannot
+    // reorder or block anything: it is the last frame the ring holds, so the peer is not stuck
+    // on a full ring, and nothing is queued or being handled, so no earlier frame of this peer
+    // is still waiting. SETs change no other node, but onChange may then run on this thread.
+    bool applyFromRing(const Message &msg, ShmRing *ring) {
+        if (msg.type != MSG_SET || queuedMessages.load() != 0) return false;
+        if (ring->head.load(std::memory_order_acquire) != ring->tail.load(std::memory_order_relaxed)) return false;
+        updateClock(msg.clock);
+        ThreadStats &st = localStats();
+        st.count(CNT_RECEIVED);
+        st.count(CNT_DIRECT);
+        long long start = nowNs();
+        handleMessageContent(msg);
+        st.metrics[MET_APPLY_NS].record(nowNs() - start);
+        return true;
+    }
 
-        {
-            std::lock_guard<std::mutex> lockClock(m);
-            updateClock(msgClock);  
+    // A co-located peer moved its traffic to a ring; frames it sent on the socket before
+    // MSG_ATTACH were already delivered, so per-peer order is kept.
+    void attachRing(int senderId) {
+        std::string name = shmRingName(port, senderId);
+        ShmRing *ring = mapRing(name, false);
+        if (!ring) {
+            std::cerr << "Error attaching ring " << name << "\n";
+            return;
+        }
+        shm_unlink(name.c_str());
+        std::lock_guard<std::mutex> lock(ringMutex);
+        ringReaders.emplace_back(&DsmNode::readRing, this, ring);
+    }
 
+    void readRing(ShmRing *ring) {
+        std::string buf;
+        uint64_t tail = ring->tail.load();
+        int idle = 0;
+        const int spin = std::thread::hardware_concurrency() > 1 ? SHM_SPIN : 0;
+        while (running) {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            if (head == tail) {
+                if (ring->closed.load()) break;
+                if (++idle < spin) continue;
+                uint32_t bell = ring->bell.load();
+                ring->sleeping.store(1);
+                if (ring->head.load() == tail && !ring->closed.load()) {
+                    timespec ts = {0, 50 * 1000 * 1000};
+                    syscall(SYS_futex, (uint32_t*)&ring->bell, FUTEX_WAIT, bell, &ts, nullptr, 0);
+                }
+                ring->sleeping.store(0);
+                continue;
+            }
+            // After an empty ring, the time from the writer's publish to this read: the ring's
+            // hand-off cost. Busy rings are not sampled, so neither side reads the clock then.
+            if (idle > 0) localStats().metrics[MET_RING_NS].record(nowNs() - ring->publishedNs.load(std::memory_order_relaxed));
+            idle = 0;
+            size_t n = (size_t)(head - tail);
+            size_t off = tail % SHM_RING_BYTES;
+            size_t first = std::min(n, SHM_RING_BYTES - off);
+            buf.append(ring->data + off, first);
+            buf.append(ring->data, n - first);
+            tail = head;
+            ring->tail.store(tail, std::memory_order_release);
+            deliverFrames(buf, ring);
+        }
+        ring->closed.store(1);
+        munmap(ring, sizeof(ShmRing));
+    }
+
+    void enqueueMessage(Message msg) {
+        updateClock(msg.clock);
+        ThreadStats &st = localStats();
+        st.count(CNT_RECEIVED);
+        msg.enqueuedNs = nowNs();
+        queuedMessages++;
+        size_t depth;
         {
             std::lock_guard<std::mutex> lock(queueMutex);
             messageQueue.push(msg);
+            depth = messageQueue.size();
         }
+        st.metrics[MET_QUEUE_DEPTH].record((long long)depth);
         cv.notify_one();
     }
 
@@ -126,109 +865,425 @@ class DsmNode {
 
             messageQueue.pop();
             lock.unlock(); 
-            handleMessageContent(msg.clock, msg.senderId, msg.content);
-        }
-    }
-
-    void handleMessageContent(int msgClock, int senderId, const std::string& content) {
-        std::istringstream iss(content);
-        std::string cmd;
-        iss >> cmd;
-
-        if (cmd == "SETREQ") {
-            int varId, val;
-            iss >> varId >> val;
-            std::lock_guard<std::mutex> lock(m);
-            if (!variables.count(varId)) return;
-            if (variables[varId].owned) {
-                variables[varId].value = val;
-                if (onChange) onChange(varId, val);
-                broadcastSet(varId, val);
-            } else {
-                forwardSetReq(varId, val);
+            handleMessageContent(msg);
+            localStats().metrics[MET_APPLY_NS].record(nowNs() - msg.enqueuedNs);
+            queuedMessages--;
+        }
+    }
+
+    void handleMessageContent(const Message &msg) {
+        if (msg.type == MSG_RESULT) {
+            Reply r{msg.arg1 != 0, msg.arg2, msg.senderId};
+            if (msg.extra.size() >= 2) {
+                r.version = msg.extra[0];
+                r.ownerVersion = msg.extra[1];
             }
+            completeRequest(msg.reqId, r);
+            return;
         }
-        else if (cmd == "CMPXCHGREQ") {
-            int varId, oldVal, newVal;
-            iss >> varId >> oldVal >> newVal;
-            std::lock_guard<std::mutex> lock(m);
-            if (!variables.count(varId)) return;
-            if (variables[varId].owned) {
-                if (variables[varId].value == oldVal) {
-                    variables[varId].value = newVal;
-                    if (onChange) onChange(varId, newVal);
-                    broadcastSet(varId, newVal);
+        Outbox out;
+        requestHops() = msg.hops;
+        {
+            Shard &shard = shardOf(msg.varId);
+            std::lock_guard<std::mutex> lock(shard.m);
+            auto it = shard.variables.find(msg.varId);
+            if (msg.type == MSG_MIGRATE) processMigrate(msg, shard.variables[msg.varId]);
+            else if (it == shard.variables.end()) {
+                if (msg.type == MSG_SET) cacheValue(msg.varId, msg.arg1, 0);
+                else reply(msg.varId, msg.origin, msg.reqId, false, 0, out);
+            }
+            else if (msg.type == MSG_SETREQ) processSetReq(msg.varId, it->second, msg.arg1, out, 0, msg.origin, msg.reqId);
+            else if (msg.type == MSG_CMPXCHGREQ) processCmpxchgReq(msg.varId, it->second, msg.arg1, msg.arg2, out, msg.origin, msg.reqId);
+            else if (msg.type == MSG_SET) {
+                if (msg.clock > it->second.version) processSet(msg.varId, it->second, msg.arg1, msg.clock);
+                if (msg.reqId && msg.origin == nodeId) out.results.push_back(std::make_pair(msg.reqId, Reply{true, it->second.value}));
+            }
+            else if (msg.type == MSG_OWNER) {
+                if (msg.clock > it->second.ownerVersion && !it->second.owned) {
+                    it->second.ownerVersion = msg.clock;
+                    it->second.owner = msg.arg1;
+                    logVar(msg.varId, it->second);
                 }
-            } else {
-                forwardCmpxchgReq(varId, oldVal, newVal);
             }
+            else if (msg.type == MSG_CATCHUP) processCatchup(msg.varId, it->second, msg.arg1, out, msg.origin, msg.reqId);
+            else if (msg.type == MSG_SUBSCRIBE) processSubscribe(msg.varId, it->second, msg.arg1, out, msg.origin, msg.reqId);
+            else if (msg.type == MSG_UNSUBSCRIBE) processUnsubscribe(msg.varId, it->second, out, msg.origin);
         }
-        else if (cmd == "SET") {
-            int varId, val;
-            iss >> varId >> val;
-            std::lock_guard<std::mutex> lock(m);
-            if (!variables.count(varId)) return;
-            variables[varId].value = val;
-            if (onChange) onChange(varId, val);
-        }
+        requestHops() = 0;
+        flush(out);
     }
 
-    void sendMessage(int peerId, const std::string &msg) {
-        if (!peers.count(peerId)) return;
-        std::cout << "Node " << nodeId << " sending to " << peerId << ": " << msg << "\n";
+    // Opens the persistent transport to a peer; called by the flusher only. Peers on this
+    // host get a shared-memory ring announced over a fresh connection, others plain TCP.
+    bool connectPeer(int peerId, Peer &peer) {
         int s = socket(AF_INET, SOCK_STREAM, 0);
         if (s < 0) {
             std::cerr << "Error creating socket\n";
-            return;
+            return false;
         }
-        if (connect(s, (sockaddr*)&peers[peerId], sizeof(peers[peerId])) < 0) {
+        if (connect(s, (sockaddr*)&peer.addr, sizeof(peer.addr)) < 0) {
             std::cerr << "Error connecting to peer " << peerId << "\n";
             close(s);
+            return false;
+        }
+        int one = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (sharedMemory && isLocalAddress(peer.addr.sin_addr)) {
+            std::string name = shmRingName(ntohs(peer.addr.sin_port), nodeId);
+            if (ShmRing *ring = mapRing(name, true)) {
+                std::string hello;
+                encodeFrame(hello, makeMessage(MSG_ATTACH, lamportClock.load(), 0, 0));
+                if (sendAll(s, hello.data(), hello.size())) {
+                    peer.transport.reset(new ShmTransport(ring, name, s));
+                    return true;
+                }
+                munmap(ring, sizeof(ShmRing));
+                shm_unlink(name.c_str());
+            }
+        }
+        peer.transport.reset(new TcpTransport(s));
+        return true;
+    }
+
+    // Appends a frame to the peer's queue. Returns the peer if the caller became its
+    // flusher and must call flushPeer, or nullptr if a flush is already in progress.
+    // `known` is false when the peer was never added and the frame was dropped.
+    Peer *queueMessage(int peerId, const Message &msg, bool &known) {
+        Peer *peer;
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+            auto it = peers.find(peerId);
+            known = it != peers.end();
+            if (!known) return nullptr;
+            peer = it->second.get();
+        }
+        TRACE("Node " << nodeId << " sending to " << peerId << ": " << describe(msg) << "\n");
+        ThreadStats &st = localStats();
+        st.count(CNT_FRAMES);
+        std::lock_guard<std::mutex> lock(peer->pendingMutex);
+        encodeFrame(peer->pending, msg);
+        if (peer->flushing) return nullptr;
+        peer->flushing = true;
+        return peer;
+    }
+
+    void flushPeer(Peer *peer) {
+        std::string out;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(peer->pendingMutex);
+                out.clear();
+                out.swap(peer->pending);
+                if (out.empty()) {
+                    peer->flushing = false;
+                    return;
+                }
+            }
+            if (!peer->transport && !connectPeer(peer->id, *peer)) {
+                failUndelivered(out);
+                continue;
+            }
+            ThreadStats &st = localStats();
+            long long start = nowNs();
+            bool sent = peer->transport->send(out.data(), out.size());
+            st.metrics[MET_SEND_NS].record(nowNs() - start);
+            st.count(CNT_FLUSHES);
+            st.count(CNT_BYTES, out.size());
+            if (!sent) {
+                std::cerr << "Error sending to peer " << peer->id << "\n";
+                peer->transport.reset();
+                failUndelivered(out);
+            }
+        }
+    }
+
+    // Requests in frames that could not be delivered fail: this node's own complete with
+    // false, forwarded ones get a failed RESULT at their origin. After a partial send the
+    // owner may still have applied some of them, so false means "not confirmed".
+    void failRequest(const Message &msg, Outbox &out) {
+        if (msg.reqId && msg.type != MSG_RESULT && msg.type != MSG_SET)
+            reply(msg.varId, msg.origin, msg.reqId, false, -1, out);
+    }
+
+    void failUndelivered(const std::string &frames) {
+        Outbox out;
+        size_t pos = 0;
+        while (frames.size() - pos >= FRAME_HEADER) {
+            size_t len = (size_t)getInt(frames.data() + pos);
+            if (frames.size() - pos - FRAME_HEADER < len) break;
+            Message msg;
+            if (decodeFrame(frames.data() + pos + FRAME_HEADER, len, msg)) failRequest(msg, out);
+            pos += FRAME_HEADER + len;
+        }
+        flush(out);
+    }
+
+    void post(int peerId, const Message &msg, Outbox &out) {
+        bool known;
+        Peer *peer = queueMessage(peerId, msg, known);
+        if (peer) out.peers.push_back(peer);
+        else if (!known) failRequest(msg, out);
+    }
+
+    void flush(const Outbox &out) {
+        for (Peer *peer : out.peers) flushPeer(peer);
+        for (auto &result : out.results) completeRequest(result.first, result.second);
+    }
+
+    Message makeMessage(MsgType type, int clock, int varId, int arg1, int arg2 = 0, int origin = 0, int reqId = 0) {
+        Message msg;
+        msg.clock = clock;
+        msg.senderId = nodeId;
+        msg.type = type;
+        msg.varId = varId;
+        msg.arg1 = arg1;
+        msg.arg2 = arg2;
+        msg.origin = origin;
+        msg.reqId = reqId;
+        return msg;
+    }
+
+    // The helpers below run with the variable's shard lock held.
+    // A clock of 0 takes a fresh Lamport tick; writeBatch passes one tick for the whole batch.
+    // The owner stamps each write with the clock of the SET it broadcasts.
+    // SETs go to the subscribers and to every node whose read lease has not expired.
+    void broadcastSet(int varId, Variable &var, int val, Outbox &out, int clock) {
+        Message msg = makeMessage(MSG_SET, clock, varId, val);
+        std::vector<int> targets;
+        for (auto &sub : var.subscribers) {
+            if (sub != nodeId) targets.push_back(sub);
+        }
+        long long now = nowUs();
+        for (auto it = var.leases.begin(); it != var.leases.end();) {
+            if (it->second < now) {
+                it = var.leases.erase(it);
+                continue;
+            }
+            if (!var.subscribers.count(it->first)) targets.push_back(it->first);
+            ++it;
+        }
+        if (flushWindowUs.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(setsMutex);
+            for (int target : targets) pendingSets[target][varId] = msg;
+            setsCv.notify_one();
             return;
         }
-        send(s, msg.c_str(), msg.size(), 0);
-        close(s);
+        for (int target : targets) post(target, msg, out);
+    }
+
+    void forwardSetReq(int varId, const Variable &var, int val, Outbox &out, int clock, int origin, int reqId) {
+        if (var.owner == nodeId) return;
+        post(var.owner, forwarded(makeMessage(MSG_SETREQ, clock ? clock : incrementClock(), varId, val, 0, origin, reqId)), out);
     }
 
-    void broadcastSet(int varId, int val) {
-        incrementClock();  
-        for (auto &sub : variables[varId].subscribers) {
-            if (sub == nodeId) continue;
-            std::ostringstream oss;
-            oss << "LC " << lamportClock << " " << nodeId << " SET " << varId << " " << val;
-            sendMessage(sub, oss.str());
+    void forwardCmpxchgReq(int varId, const Variable &var, int oldVal, int newVal, Outbox &out, int origin, int reqId) {
+        if (var.owner == nodeId) return;
+        post(var.owner, forwarded(makeMessage(MSG_CMPXCHGREQ, incrementClock(), varId, oldVal, newVal, origin, reqId)), out);
+    }
+
+    // Reports the owner's outcome of a request, and its value afterwards, to the node that
+    // issued it. Passing the variable also reports its versions.
+    void reply(int varId, int origin, int reqId, bool ok, int value, Outbox &out, const Variable *var = nullptr) {
+        if (reqId == 0) return;
+        if (origin == nodeId) {
+            Reply r{ok, value, nodeId};
+            if (var) {
+                r.version = var->version;
+                r.ownerVersion = var->ownerVersion;
+            }
+            out.results.push_back(std::make_pair(reqId, r));
+            return;
         }
+        Message msg = makeMessage(MSG_RESULT, incrementClock(), varId, ok ? 1 : 0, value, origin, reqId);
+        if (var) msg.extra = {var->version, var->ownerVersion};
+        post(origin, msg, out);
     }
 
-    void forwardSetReq(int varId, int val) {
-        int owner = *variables[varId].subscribers.begin();
-        if (owner == nodeId) return;
-        incrementClock(); 
-        std::ostringstream oss;
-        oss << "LC " << lamportClock << " " << nodeId << " SETREQ " << varId << " " << val;
-        sendMessage(owner, oss.str());
+    void processSet(int varId, Variable &var, int val, int version) {
+        var.value = val;
+        var.version = version;
+        publish(varId, val);
+        logVar(varId, var);
+        localStats().count(CNT_APPLIED);
+        if (onChange) onChange(varId, val);
     }
 
-    void forwardCmpxchgReq(int varId, int oldVal, int newVal) {
-        int owner = *variables[varId].subscribers.begin();
-        if (owner == nodeId) return;
-        incrementClock(); 
-        std::ostringstream oss;
-        oss << "LC " << lamportClock << " " << nodeId << " CMPXCHGREQ "
-            << varId << " " << oldVal << " " << newVal;
-        sendMessage(owner, oss.str());
+    void processSetReq(int varId, Variable &var, int val, Outbox &out, int clock, int origin, int reqId = 0) {
+        if (var.owned) {
+            localStats().metrics[MET_HOPS].record(requestHops());
+            if (clock <= var.version) clock = incrementClock();   // never stamp a write older than the one it replaces
+            processSet(varId, var, val, clock);
+            broadcastSet(varId, var, val, out, clock);
+            reply(varId, origin, reqId, true, val, out);
+            noteWrite(varId, var, origin, out);
+        } else {
+            forwardSetReq(varId, var, val, out, clock, origin, reqId);
+        }
+    }
+
+    void processCmpxchgReq(int varId, Variable &var, int oldVal, int newVal, Outbox &out, int origin = 0, int reqId = 0) {
+        if (var.owned) {
+            localStats().metrics[MET_HOPS].record(requestHops());
+            bool ok = var.value == oldVal;
+            if (ok) {
+                int clock = incrementClock();
+                processSet(varId, var, newVal, clock);
+                broadcastSet(varId, var, newVal, out, clock);
+            }
+            reply(varId, origin, reqId, ok, var.value, out);
+            noteWrite(varId, var, origin, out);
+        } else {
+            forwardCmpxchgReq(varId, var, oldVal, newVal, out, origin, reqId);
+        }
+    }
+
+    // Ownership follows the writers: every migrationWindow writes, the owner hands the
+    // variable to a subscriber that issued more than half of them.
+    std::atomic<int> migrationWindow;
+
+    void noteWrite(int varId, Variable &var, int origin, Outbox &out) {
+        int window = migrationWindow.load(std::memory_order_relaxed);
+        if (window <= 0) return;
+        var.writeCounts[origin]++;
+        if (++var.windowWrites < window) return;
+        auto top = std::max_element(var.writeCounts.begin(), var.writeCounts.end(),
+            [](const std::pair<const int, int> &a, const std::pair<const int, int> &b) { return a.second < b.second; });
+        int target = top->first, count = top->second;
+        var.writeCounts.clear();
+        var.windowWrites = 0;
+        if (target != nodeId && 2 * count > window && var.subscribers.count(target)) migrate(varId, var, target, out);
+    }
+
+    // Hands ownership to `target`. The MIGRATE carries the value, subscribers and leases and
+    // is stamped after every SET this node issued for the variable, so the new owner's SETs
+    // order after them; subscribers drop any SET older than the newest they applied.
+    // Requests that still reach this node are forwarded to the new owner.
+    void migrate(int varId, Variable &var, int target, Outbox &out) {
+        int clock = incrementClock();
+        Message msg = makeMessage(MSG_MIGRATE, clock, varId, var.value);
+        msg.extra.push_back((int)var.subscribers.size());
+        msg.extra.insert(msg.extra.end(), var.subscribers.begin(), var.subscribers.end());
+        long long now = nowUs();
+        std::vector<int> leases;
+        for (auto &lease : var.leases) {
+            if (lease.second <= now) continue;
+            leases.push_back(lease.first);
+            leases.push_back((int)((lease.second - now) / 1000));
+        }
+        msg.extra.push_back((int)leases.size() / 2);
+        msg.extra.insert(msg.extra.end(), leases.begin(), leases.end());
+        post(target, msg, out);
+        Message notice = makeMessage(MSG_OWNER, clock, varId, target);
+        for (int sub : var.subscribers) {
+            if (sub != nodeId && sub != target) post(sub, notice, out);
+        }
+        var.owned = false;
+        var.owner = target;
+        var.version = clock;
+        var.ownerVersion = clock;
+        var.leases.clear();
+        logVar(varId, var);
+    }
+
+    void processMigrate(const Message &msg, Variable &var) {
+        if (msg.clock <= var.ownerVersion) return;
+        size_t pos = 0;
+        int subCount = pos < msg.extra.size() ? msg.extra[pos++] : 0;
+        var.subscribers.clear();
+        for (int i = 0; i < subCount && pos < msg.extra.size(); i++) var.subscribers.insert(msg.extra[pos++]);
+        var.subscribers.insert(nodeId);
+        int leaseCount = pos < msg.extra.size() ? msg.extra[pos++] : 0;
+        long long now = nowUs();
+        var.leases.clear();
+        for (int i = 0; i < leaseCount && pos + 1 < msg.extra.size(); i++, pos += 2)
+            var.leases[msg.extra[pos]] = now + msg.extra[pos + 1] * 1000LL;
+        var.owned = true;
+        var.owner = nodeId;
+        var.ownerVersion = msg.clock;
+        var.writeCounts.clear();
+        var.windowWrites = 0;
+        processSet(msg.varId, var, msg.arg1, msg.clock);
+    }
+
+    // Answers a restarted node that holds `version`: the current owner resends the
+    // ownership and, tagged with the request, a SET stamped with the newest version, which
+    // the node applies only if it missed it.
+    void processCatchup(int varId, Variable &var, int version, Outbox &out, int origin, int reqId) {
+        if (!var.owned) {
+            post(var.owner, forwarded(makeMessage(MSG_CATCHUP, incrementClock(), varId, version, 0, origin, reqId)), out);
+            return;
+        }
+        if (var.ownerVersion) post(origin, makeMessage(MSG_OWNER, var.ownerVersion, varId, nodeId), out);
+        post(origin, makeMessage(MSG_SET, var.version, varId, var.value, 0, origin, reqId), out);
+    }
+
+    // leaseMs == 0 adds `origin` as a subscriber; otherwise it gets SETs until the lease runs out.
+    // The RESULT carrying the current value is queued before any later SET to the same node.
+    void processSubscribe(int varId, Variable &var, int leaseMs, Outbox &out, int origin, int reqId) {
+        if (!var.owned) {
+            post(var.owner, forwarded(makeMessage(MSG_SUBSCRIBE, incrementClock(), varId, leaseMs, 0, origin, reqId)), out);
+            return;
+        }
+        if (leaseMs == 0) var.subscribers.insert(origin);
+        else var.leases[origin] = std::max(var.leases[origin], nowUs() + leaseMs * 1000LL);
+        reply(varId, origin, reqId, true, var.value, out, &var);
+    }
+
+    void processUnsubscribe(int varId, Variable &var, Outbox &out, int origin) {
+        if (!var.owned) {
+            post(var.owner, forwarded(makeMessage(MSG_UNSUBSCRIBE, incrementClock(), varId, 0, 0, origin)), out);
+            return;
+        }
+        if (origin != nodeId) var.subscribers.erase(origin);
+    }
+
+    // Sends a SUBSCRIBE for a variable this node does not hold to its configured owner.
+    void requestFromOwner(int varId, int leaseMs, const Completion &done) {
+        auto it = directory.find(varId);
+        if (it == directory.end()) {
+            done(Reply{false, -1});
+            return;
+        }
+        Outbox out;
+        int reqId = registerRequest(done);
+        post(it->second, makeMessage(MSG_SUBSCRIBE, incrementClock(), varId, leaseMs, 0, nodeId, reqId), out);
+        flush(out);
+    }
+
+    template<typename Apply>
+    void issue(int varId, const std::function<void(bool)> &done, Apply apply) {
+        incrementClock();
+        Outbox out;
+        int reqId = done ? registerRequest([done](const Reply &r) { done(r.ok); }) : 0;
+        {
+            Shard &shard = shardOf(varId);
+            std::lock_guard<std::mutex> lock(shard.m);
+            auto it = shard.variables.find(varId);
+            if (it == shard.variables.end()) out.results.push_back(std::make_pair(reqId, Reply{false, -1}));
+            else apply(it->second, out, reqId);
+        }
+        flush(out);
     }
 
 public:
     DsmNode(int id, int basePort, const std::map<int,std::set<int>> &subs,
             const std::function<void(int,int)> &cb)
-        : nodeId(id), port(basePort + id), lamportClock(0), onChange(cb), running(true), processingRunning(true)
+        : nodeId(id), port(basePort + id), lamportClock(0), slots(new std::atomic<uint64_t>[DENSE_VARS]),
+          leaseUntil(new std::atomic<long long>[DENSE_VARS]),
+          onChange(cb), running(true), nextRequestId(0), queuedMessages(0), processingRunning(true), flushWindowUs(0), flusherRunning(true),
+          migrationWindow(128)
     {
+        for (int i = 0; i < DENSE_VARS; i++) {
+            slots[i].store(0, std::memory_order_relaxed);
+            leaseUntil[i].store(0, std::memory_order_relaxed);
+        }
         sockfd = socket(AF_INET, SOCK_STREAM, 0);
         if (sockfd < 0) {
             std::cerr << "Error creating socket\n";
             exit(1);
         }
+        int reuse = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
         sockaddr_in addr;
         memset(&addr, 0, sizeof(addr));
         addr.sin_family = AF_INET;
@@ -239,30 +1294,77 @@ public:
             exit(1);
         }
 
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (epollFd < 0 || wakeFd < 0) {
+            std::cerr << "Error creating epoll reactor\n";
+            exit(1);
+        }
+        fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+        watch(sockfd);
+        watch(wakeFd);
         serverThread = std::thread(&DsmNode::serverLoop, this);
 
         for (auto &kv : subs) {
             int varId = kv.first;
+            if (kv.second.empty()) continue;
             if (kv.second.count(id)) {
                 Variable v;
                 v.value = 0;
-                v.owned = (*kv.second.begin() == id);
+                v.owner = *kv.second.begin();
+                v.owned = (v.owner == id);
                 v.subscribers = kv.second;
-                variables[varId] = v;
+                shardOf(varId).variables[varId] = v;
+                publish(varId, v.value);
             }
+            directory[varId] = *kv.second.begin();
         }
 
         processingThread = std::thread(&DsmNode::processMessages, this);
+        flusherThread = std::thread(&DsmNode::flushSets, this);
     }
 
     void stop() {
+        setStatsInterval(std::chrono::milliseconds(0));
         running = false;
         processingRunning = false;
-        shutdown(sockfd, SHUT_RDWR);
-        close(sockfd);
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) std::cerr << "Error waking reactor\n";
         cv.notify_all();
         if (serverThread.joinable()) serverThread.join();
+        close(sockfd);
+        close(epollFd);
+        close(wakeFd);
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            for (auto &t : ringReaders) t.join();
+            ringReaders.clear();
+        }
         if (processingThread.joinable()) processingThread.join();
+        {
+            std::lock_guard<std::mutex> lock(setsMutex);
+            flusherRunning = false;
+        }
+        setsCv.notify_all();
+        if (flusherThread.joinable()) flusherThread.join();
+        {
+            std::lock_guard<std::mutex> lock(walMutex);
+            loggerRunning = false;
+        }
+        walCv.notify_all();
+        durableCv.notify_all();
+        if (loggerThread.joinable()) loggerThread.join();
+        if (walFd >= 0) close(walFd);
+        std::unordered_map<int, Completion> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex);
+            abandoned.swap(inflight);
+        }
+        for (auto &kv : abandoned) {
+            if (kv.second) kv.second(Reply{false, -1});
+        }
+        std::lock_guard<std::mutex> lock(peersMutex);
+        for (auto &kv : peers) kv.second->transport.reset();
     }
 
     void addPeer(int peerId, const std::string &ip, int basePort) {
@@ -274,89 +1376,734 @@ public:
             std::cerr << "Invalid IP address: " << ip << "\n";
             return;
         }
-        peers[peerId] = addr;
+        std::lock_guard<std::mutex> lock(peersMutex);
+        auto &peer = peers[peerId];
+        if (!peer) peer.reset(new Peer());
+        peer->id = peerId;
+        peer->addr = addr;
     }
 
-    void writeVar(int varId, int val) {
-        std::lock_guard<std::mutex> lock(m);
-        incrementClock();
-        if (!variables.count(varId)) return;
-        if (variables[varId].owned) {
-            variables[varId].value = val;
-            if (onChange) onChange(varId, val);
-            broadcastSet(varId, val);
-        } else {
-            forwardSetReq(varId, val);
+    // Writes and compare-exchanges complete once the owner has applied (or rejected)
+    // them: `done` runs with the outcome, on the caller's thread for owned variables and
+    // on the processing thread otherwise. Any number of requests may be in flight.
+    // Unsubscribed variables, and requests that cannot be delivered, complete with false;
+    // stop() fails whatever is pending.
+    void writeVar(int varId, int val, const std::function<void(bool)> &done) {
+        issue(varId, done, [&](Variable &var, Outbox &out, int reqId) {
+            processSetReq(varId, var, val, out, 0, nodeId, reqId);
+        });
+    }
+
+    void compareExchange(int varId, int oldVal, int newVal, const std::function<void(bool)> &done) {
+        issue(varId, done, [&](Variable &var, Outbox &out, int reqId) {
+            processCmpxchgReq(varId, var, oldVal, newVal, out, nodeId, reqId);
+        });
+    }
+
+    std::future<bool> writeVar(int varId, int val) {
+        auto result = std::make_shared<std::promise<bool>>();
+        writeVar(varId, val, [result](bool ok) { result->set_value(ok); });
+        return result->get_future();
+    }
+
+    std::future<bool> compareExchange(int varId, int oldVal, int newVal) {
+        auto result = std::make_shared<std::promise<bool>>();
+        compareExchange(varId, oldVal, newVal, [result](bool ok) { result->set_value(ok); });
+        return result->get_future();
+    }
+
+    // Applies all updates as one logical write stamped with a single Lamport tick.
+    // Repeated ids keep their last value. Every touched shard is locked, in index order,
+    // before the tick is taken, so a concurrent write to one of them either applied
+    // earlier with an older tick or applies later with a newer one.
+    void writeBatch(const std::vector<std::pair<int, int>> &updates) {
+        std::map<int, int> latest;
+        for (auto &u : updates) latest[u.first] = u.second;
+        std::array<std::vector<std::pair<int, int>>, SHARD_COUNT> byShard;
+        for (auto &kv : latest) byShard[(unsigned)kv.first % SHARD_COUNT].push_back(kv);
+        std::array<std::unique_lock<std::mutex>, SHARD_COUNT> locks;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            if (!byShard[k].empty()) locks[k] = std::unique_lock<std::mutex>(shards[k].m);
+        }
+        int clock = incrementClock();
+        Outbox out;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            for (auto &kv : byShard[k]) {
+                auto it = shards[k].variables.find(kv.first);
+                if (it != shards[k].variables.end()) processSetReq(kv.first, it->second, kv.second, out, clock, nodeId);
+            }
+        }
+        for (auto &lock : locks) {
+            if (lock.owns_lock()) lock.unlock();
         }
+        flush(out);
     }
 
-    void compareExchange(int varId, int oldVal, int newVal) {
-        std::lock_guard<std::mutex> lock(m);
-        incrementClock(); 
-        if (!variables.count(varId)) return;
-        if (variables[varId].owned) {
-            if (variables[varId].value == oldVal) {
-                variables[varId].value = newVal;
-                if (onChange) onChange(varId, newVal);
-                broadcastSet(varId, newVal);
+    // Coalesces outgoing SET broadcasts for `window` before sending; zero sends immediately.
+    // Change it before traffic starts: SETs parked under a window are not ordered against
+    // immediate ones sent after switching back to zero.
+    void setFlushWindow(std::chrono::microseconds window) {
+        flushWindowUs = window.count();
+    }
+
+    // Makes the node durable under `dir`: loads the snapshot, replays the log after it and
+    // from then on logs every change. Restart cost is bounded by the snapshot plus at most
+    // SNAPSHOT_EVERY bytes of log. The owners of the variables held here are then asked for
+    // whatever this node missed while it was down; the future is ready once all answered.
+    // Call after addPeer and before any traffic.
+    std::future<bool> recover(const std::string &dir) {
+        logDir = dir;
+        mkdir(dir.c_str(), 0755);
+        int maxClock = 0;
+        std::string data;
+        if (readFile(dir + "/snapshot", data) && data.size() >= 12 && getInt(data.data()) == SNAPSHOT_MAGIC) {
+            maxClock = getInt(data.data() + 4);
+            size_t count = (size_t)getInt(data.data() + 8);
+            for (size_t i = 0; i < count && 12 + (i + 1) * SNAPSHOT_RECORD * 4 <= data.size(); i++)
+                restoreVar(data.data() + 12 + i * SNAPSHOT_RECORD * 4, maxClock);
+        }
+        data.clear();
+        std::string walPath = dir + "/wal";
+        readFile(walPath, data);
+        size_t whole = data.size() - data.size() % (WAL_RECORD * 4);   // drop a torn tail
+        for (size_t off = 0; off < whole; off += WAL_RECORD * 4) {
+            restoreVar(data.data() + off, maxClock);
+            maxClock = std::max(maxClock, getInt(data.data() + off + 20));
+        }
+        updateClock(maxClock);
+
+        walFd = open(walPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (walFd < 0) {
+            std::cerr << "Error opening log " << walPath << "\n";
+            exit(1);
+        }
+        if (ftruncate(walFd, whole) < 0) std::cerr << "Error truncating log " << walPath << "\n";
+        walBytes = whole;
+        loggerRunning = true;
+        loggerThread = std::thread(&DsmNode::writeLog, this);
+        logging = true;
+
+        std::vector<std::pair<int, int>> stale;    // (owner, varId) of held variables owned elsewhere
+        std::vector<int> versions;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.m);
+            for (auto &kv : shard.variables) {
+                if (kv.second.owned) continue;
+                stale.push_back(std::make_pair(kv.second.owner, kv.first));
+                versions.push_back(kv.second.version);
             }
-        } else {
-            forwardCmpxchgReq(varId, oldVal, newVal);
         }
+        auto result = std::make_shared<std::promise<bool>>();
+        if (stale.empty()) {
+            result->set_value(true);
+            return result->get_future();
+        }
+        auto left = std::make_shared<std::atomic<int>>((int)stale.size());
+        auto allOk = std::make_shared<std::atomic<bool>>(true);
+        Outbox out;
+        for (size_t i = 0; i < stale.size(); i++) {
+            int reqId = registerRequest([left, allOk, result](const Reply &r) {
+                if (!r.ok) *allOk = false;
+                if (--*left == 0) result->set_value(allOk->load());
+            });
+            post(stale[i].first, makeMessage(MSG_CATCHUP, incrementClock(), stale[i].second, versions[i], 0, nodeId, reqId), out);
+        }
+        flush(out);
+        return result->get_future();
+    }
+
+    // Blocks until every change logged so far is on disk. Returns false if the log failed,
+    // in which case those changes are not durable and no later ones are logged.
+    bool syncLog() {
+        std::unique_lock<std::mutex> lock(walMutex);
+        long long target = walAppended;
+        durableCv.wait(lock, [this, target]() { return walDurable >= target || walFailed || !loggerRunning; });
+        return !walFailed && walDurable >= target;
+    }
+
+    // Whether peers on this host are reached over shared memory; set before traffic starts.
+    void setSharedMemory(bool enabled) {
+        sharedMemory = enabled;
+    }
+
+    // Number of writes the owner counts before considering a migration; 0 pins ownership.
+    void setMigrationWindow(int writes) {
+        migrationWindow = writes;
+    }
+
+    int ownerOf(int varId) {
+        Shard &shard = shardOf(varId);
+        std::lock_guard<std::mutex> lock(shard.m);
+        auto it = shard.variables.find(varId);
+        if (it != shard.variables.end()) return it->second.owner;
+        auto dir = directory.find(varId);
+        return dir == directory.end() ? -1 : dir->second;
+    }
+
+    // Frames queued to peers since construction.
+    long long messagesSent() {
+        return (long long)counterTotal(CNT_FRAMES);
+    }
+
+    uint64_t counterTotal(Counter c) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        uint64_t total = 0;
+        for (auto &st : threadStats) total += st->counters[c].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // One metric's histogram merged over every thread, HIST_BUCKETS counts.
+    std::vector<uint64_t> metricHistogram(Metric m) {
+        std::vector<uint64_t> merged(HIST_BUCKETS, 0);
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (auto &st : threadStats)
+            for (int b = 0; b < HIST_BUCKETS; b++) merged[b] += st->metrics[m].counts[b].load(std::memory_order_relaxed);
+        return merged;
+    }
+
+    // Merges every thread's counters and histograms and prints one line per metric with
+    // p50/p90/p99/max, each the lower bound of its bucket.
+    void printStats(std::ostream &os) {
+        uint64_t counters[CNT_COUNT] = {};
+        std::vector<uint64_t> merged((size_t)MET_COUNT * HIST_BUCKETS, 0);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            for (auto &st : threadStats) {
+                for (int c = 0; c < CNT_COUNT; c++) counters[c] += st->counters[c].load(std::memory_order_relaxed);
+                for (int m = 0; m < MET_COUNT; m++)
+                    for (int b = 0; b < HIST_BUCKETS; b++)
+                        merged[(size_t)m * HIST_BUCKETS + b] += st->metrics[m].counts[b].load(std::memory_order_relaxed);
+            }
+        }
+        std::ostringstream oss;
+        oss << "Node " << nodeId << " stats:";
+        for (int c = 0; c < CNT_COUNT; c++) oss << " " << counterNames[c] << "=" << counters[c];
+        oss << "\n";
+        for (int m = 0; m < MET_COUNT; m++) {
+            const uint64_t *h = &merged[(size_t)m * HIST_BUCKETS];
+            uint64_t total = 0;
+            for (int b = 0; b < HIST_BUCKETS; b++) total += h[b];
+            oss << "  " << metricNames[m] << " n=" << total;
+            if (total) {
+                const double ranks[] = {0.50, 0.90, 0.99, 1.0};
+                const char *labels[] = {"p50", "p90", "p99", "max"};
+                for (int r = 0; r < 4; r++) oss << " " << labels[r] << "=" << histogramPercentile(h, ranks[r]);
+            }
+            oss << "\n";
+        }
+        os << oss.str() << std::flush;
+    }
+
+    // Prints the stats to stderr every `interval`; zero stops the dump.
+    void setStatsInterval(std::chrono::milliseconds interval) {
+        {
+            std::lock_guard<std::mutex> lock(statsWaitMutex);
+            statsRunning = false;
+        }
+        statsCv.notify_all();
+        if (statsThread.joinable()) statsThread.join();
+        if (interval.count() <= 0) return;
+        statsRunning = true;
+        statsThread = std::thread(&DsmNode::dumpStatsPeriodically, this, interval);
     }
 
     int readVar(int varId) {
-        std::lock_guard<std::mutex> lock(m);
-        if (!variables.count(varId)) return -1;
-        return variables[varId].value;
+        if ((unsigned)varId < (unsigned)DENSE_VARS) {
+            uint64_t slot = slots[varId].load(std::memory_order_acquire);
+            return (slot & SLOT_PRESENT) ? (int)(uint32_t)slot : -1;
+        }
+        Shard &shard = shardOf(varId);
+        std::lock_guard<std::mutex> lock(shard.m);
+        auto it = shard.variables.find(varId);
+        if (it == shard.variables.end()) return -1;
+        return it->second.value;
+    }
+
+    // Reads a variable this node may not hold. Held variables and unexpired leases are
+    // served locally; otherwise the value is fetched from the owner, which keeps sending
+    // SETs to this node for `lease` so the cached copy stays current. The lease is timed
+    // from before the request, so it always ends before the owner's. Returns -1 for
+    // unknown variables, when the owner does not answer within `timeout`, and on the
+    // processing thread (from onChange or a completion), which is the thread that would
+    // have to handle the answer.
+    int readVar(int varId, std::chrono::milliseconds lease,
+                std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) {
+        if ((unsigned)varId < (unsigned)DENSE_VARS) {
+            uint64_t slot = slots[varId].load(std::memory_order_acquire);
+            if (slot & SLOT_PRESENT) return (int)(uint32_t)slot;
+            if ((slot & SLOT_CACHED) && nowUs() < leaseUntil[varId].load(std::memory_order_relaxed)) return (int)(uint32_t)slot;
+        }
+        int held = readVar(varId);
+        if (held != -1 || !directory.count(varId)) return held;   // ids past DENSE_VARS are never cached
+        if (std::this_thread::get_id() == processingThread.get_id()) return -1;
+        long long until = nowUs() + lease.count() * 1000LL;
+        auto result = std::make_shared<std::promise<int>>();
+        requestFromOwner(varId, (int)std::max<long long>(1, lease.count()), [this, varId, until, result](const Reply &r) {
+            if (r.ok) cacheValue(varId, r.value, until);
+            result->set_value(r.ok ? r.value : -1);
+        });
+        auto value = result->get_future();
+        if (value.wait_for(timeout) != std::future_status::ready) return -1;
+        return value.get();
+    }
+
+    // Joins the subscriber set of a configured variable at run time. The node holds
+    // the variable, with the owner's current value, once the future is ready. Owner and
+    // versions come from the reply, which the current owner sends after any migration.
+    std::future<bool> subscribe(int varId) {
+        auto result = std::make_shared<std::promise<bool>>();
+        {
+            Shard &shard = shardOf(varId);
+            std::lock_guard<std::mutex> lock(shard.m);
+            if (shard.variables.count(varId)) {
+                result->set_value(true);
+                return result->get_future();
+            }
+        }
+        requestFromOwner(varId, 0, [this, varId, result](const Reply &r) {
+            if (r.ok) {
+                Shard &shard = shardOf(varId);
+                std::lock_guard<std::mutex> lock(shard.m);
+                if (!shard.variables.count(varId)) {
+                    Variable v;
+                    v.value = r.value;
+                    v.owner = r.owner;
+                    v.owned = false;
+                    v.version = r.version;
+                    v.ownerVersion = r.ownerVersion;
+                    v.subscribers.insert(nodeId);
+                    shard.variables[varId] = v;
+                    publish(varId, r.value);
+                }
+            }
+            result->set_value(r.ok);
+        });
+        return result->get_future();
+    }
+
+    // Leaves the subscriber set; the owner of a variable cannot unsubscribe.
+    bool unsubscribe(int varId) {
+        Outbox out;
+        {
+            Shard &shard = shardOf(varId);
+            std::lock_guard<std::mutex> lock(shard.m);
+            auto it = shard.variables.find(varId);
+            if (it == shard.variables.end() || it->second.owned) return false;
+            processUnsubscribe(varId, it->second, out, nodeId);
+            if ((unsigned)varId < (unsigned)DENSE_VARS) slots[varId].store(0, std::memory_order_release);
+            shard.variables.erase(it);
+        }
+        flush(out);
+        return true;
     }
 
     void printFinalValues() {
-        std::lock_guard<std::mutex> lock(m);
+        std::map<int, int> values;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.m);
+            for (auto &pair : shard.variables) values[pair.first] = pair.second.value;
+        }
         std::cout << "\nNode " << nodeId << " final values:\n";
-        for (auto &pair : variables) {
+        for (auto &pair : values) {
             std::cout << "  Var " << pair.first 
-                      << " = " << pair.second.value << "\n";
+                      << " = " << pair.second << "\n";
         }
         std::cout << std::endl;
     }
+};
 
-private:
-    void processSet(int varId, int val) {
-        if (!variables.count(varId)) return;
-        variables[varId].value = val;
-        if (onChange) onChange(varId, val);
+// Benchmark mode: one forked process per node on localhost, each driving a random
+// read/write/CAS mix over the variables it holds. A written value encodes its writer
+// and a sequence number, and the writer stores the time it issued that value in shared
+// memory, so every other node that sees the value can compute write-to-visible latency
+// on the host-wide steady clock.
+const int BENCH_MAX_NODES = 64;
+const int BENCH_SEQ_SPACE = 1 << 20;
+const int BENCH_MAX_SAMPLES = 1 << 18;
+
+struct BenchConfig {
+    int nodes = 3;
+    int vars = 64;
+    int fanout = 2;          // subscribers per variable, owner included
+    int seconds = 5;
+    int readPct = 80;
+    int casPct = 5;          // writes get the rest
+    int window = 64;         // requests in flight per node
+    int flushUs = 0;
+    int migrate = 128;
+    int shm = 1;             // 0 forces TCP between the local nodes
+    int statsMs = 0;         // per-node metrics dump period; also prints them once at the end
+    int pingpong = 0;        // round trips between two nodes instead of the mix
+    int port = 6000;
+};
+
+struct BenchNodeStats {
+    long long reads, writes, cas, casOk, messages;
+    int samples;
+    uint64_t ringWait[HIST_BUCKETS];     // ping-pong: the node's ring_wait_ns histogram
+    uint64_t fromRing;                   // ping-pong: SETs applied by the ring reader
+};
+
+struct BenchShared {
+    std::atomic<int> ready;
+    std::atomic<int> finished;
+    BenchNodeStats stats[BENCH_MAX_NODES];
+};
+
+static void *sharedAlloc(size_t bytes) {
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        std::cerr << "Error mapping benchmark memory\n";
+        exit(1);
     }
+    return p;
+}
 
-    void processSetReq(int varId, int val) {
-        if (!variables.count(varId)) return;
-        if (variables[varId].owned) {
-            variables[varId].value = val;
-            if (onChange) onChange(varId, val);
-            broadcastSet(varId, val);
-        } else {
-            forwardSetReq(varId, val);
+static void waitFor(std::atomic<int> &counter, int target) {
+    while (counter.load() < target) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static void runBenchNode(const BenchConfig &cfg, int id, BenchShared *shared,
+                         std::atomic<long long> *writeTimes, long long *latencies) {
+    std::map<int, std::set<int>> subs;
+    for (int v = 0; v < cfg.vars; v++)
+        for (int k = 0; k < cfg.fanout; k++) subs[v].insert((v + k) % cfg.nodes);
+
+    BenchNodeStats &stats = shared->stats[id];
+    std::atomic<int> samples(0);
+    auto cb = [&](int, int val) {
+        int writer = val / BENCH_SEQ_SPACE;
+        if (val <= 0 || writer == id || writer >= cfg.nodes) return;
+        long long start = writeTimes[(long long)writer * BENCH_SEQ_SPACE + val % BENCH_SEQ_SPACE].load(std::memory_order_relaxed);
+        int n = samples.fetch_add(1);
+        if (start && n < BENCH_MAX_SAMPLES) latencies[(long long)id * BENCH_MAX_SAMPLES + n] = nowNs() - start;
+    };
+
+    DsmNode node(id, cfg.port, subs, cb);
+    node.setFlushWindow(std::chrono::microseconds(cfg.flushUs));
+    node.setMigrationWindow(cfg.migrate);
+    node.setSharedMemory(cfg.shm != 0);
+    node.setStatsInterval(std::chrono::milliseconds(cfg.statsMs));
+    for (int p = 0; p < cfg.nodes; p++)
+        if (p != id) node.addPeer(p, "127.0.0.1", cfg.port);
+    std::vector<int> held;
+    for (auto &kv : subs)
+        if (kv.second.count(id)) held.push_back(kv.first);
+
+    shared->ready++;
+    waitFor(shared->ready, cfg.nodes);
+
+    std::mt19937 rng(1234 + id);
+    std::atomic<int> pending(0);
+    std::atomic<long long> casOk(0);
+    int seq = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.seconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (held.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        int varId = held[rng() % held.size()];
+        int roll = rng() % 100;
+        if (roll < cfg.readPct) {
+            node.readVar(varId);
+            stats.reads++;
+            continue;
+        }
+        while (pending.load() >= cfg.window && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+        seq = seq % (BENCH_SEQ_SPACE - 1) + 1;
+        int val = id * BENCH_SEQ_SPACE + seq;
+        writeTimes[(long long)id * BENCH_SEQ_SPACE + seq].store(nowNs(), std::memory_order_relaxed);
+        pending++;
+        if (roll < cfg.readPct + cfg.casPct) {
+            stats.cas++;
+            node.compareExchange(varId, node.readVar(varId), val, [&](bool ok) {
+                if (ok) casOk++;
+                pending--;
+            });
+        }
+        else {
+            stats.writes++;
+            node.writeVar(varId, val, [&](bool) { pending--; });
         }
     }
 
-    void processCmpxchgReq(int varId, int oldVal, int newVal) {
-        if (!variables.count(varId)) return;
-        if (variables[varId].owned) {
-            if (variables[varId].value == oldVal) {
-                variables[varId].value = newVal;
-                if (onChange) onChange(varId, newVal);
-                broadcastSet(varId, newVal);
-            }
-        } else {
-            forwardCmpxchgReq(varId, oldVal, newVal);
+    // Let outstanding requests and their broadcasts land before counting.
+    auto drainUntil = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (pending.load() > 0 && std::chrono::steady_clock::now() < drainUntil)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    stats.casOk = casOk.load();
+    stats.messages = node.messagesSent();
+    stats.samples = std::min(samples.load(), BENCH_MAX_SAMPLES);
+    if (cfg.statsMs > 0) node.printStats(std::cerr);
+
+    shared->finished++;
+    waitFor(shared->finished, cfg.nodes);
+    node.stop();
+}
+
+// Latency mode: node 0 writes var 0, node 1 answers every change by writing the same
+// value to var 1, and node 0 times the round trip until it reads it back. One round trip
+// is two one-way updates through the whole stack: transport, dispatch and apply. Each node
+// also hands back its ring_wait_ns histogram, the ring's own share of that time.
+static void runPingPongNode(const BenchConfig &cfg, int id, BenchShared *shared, long long *latencies) {
+    std::map<int, std::set<int>> subs = {{0, {0, 1}}, {1, {1, 0}}};
+    DsmNode *self = nullptr;
+    auto cb = [&](int varId, int val) {
+        if (id == 1 && varId == 0 && val > 0) self->writeVar(1, val, nullptr);
+    };
+    DsmNode node(id, cfg.port, subs, cb);
+    self = &node;
+    node.setMigrationWindow(0);
+    node.setSharedMemory(cfg.shm != 0);
+    node.addPeer(1 - id, "127.0.0.1", cfg.port);
+    shared->ready++;
+    waitFor(shared->ready, 2);
+    if (id == 0) {
+        int rounds = std::min(cfg.pingpong, BENCH_MAX_SAMPLES);
+        for (int i = 1; i <= rounds; i++) {
+            long long start = nowNs();
+            node.writeVar(0, i, nullptr);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            while (node.readVar(1) != i && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+            latencies[i - 1] = nowNs() - start;
         }
+        shared->stats[0].samples = rounds;
     }
-};
+    shared->finished++;
+    waitFor(shared->finished, 2);
+    std::vector<uint64_t> ringWait = node.metricHistogram(MET_RING_NS);
+    std::copy(ringWait.begin(), ringWait.end(), shared->stats[id].ringWait);
+    shared->stats[id].fromRing = node.counterTotal(CNT_DIRECT);
+    node.stop();
+}
+
+static int runBenchmark(const BenchConfig &cfg) {
+    auto *shared = (BenchShared*)sharedAlloc(sizeof(BenchShared));
+    auto *writeTimes = (std::atomic<long long>*)sharedAlloc(sizeof(std::atomic<long long>) * cfg.nodes * BENCH_SEQ_SPACE);
+    auto *latencies = (long long*)sharedAlloc(sizeof(long long) * cfg.nodes * BENCH_MAX_SAMPLES);
+    verbose = false;
+
+    std::vector<pid_t> children;
+    for (int id = 0; id < cfg.nodes; id++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Error forking node " << id << "\n";
+            for (pid_t c : children) kill(c, SIGKILL);
+            return 1;
+        }
+        if (pid == 0) {
+            if (cfg.pingpong) runPingPongNode(cfg, id, shared, latencies);
+            else runBenchNode(cfg, id, shared, writeTimes, latencies);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    bool failed = false;
+    for (pid_t c : children) {
+        int status = 0;
+        waitpid(c, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+    }
+    if (failed) {
+        std::cerr << "A benchmark node failed\n";
+        return 1;
+    }
+
+    if (cfg.pingpong) {
+        std::vector<long long> rtt(latencies, latencies + shared->stats[0].samples);
+        std::sort(rtt.begin(), rtt.end());
+        auto pct = [&](double p) { return rtt[std::min(rtt.size() - 1, (size_t)(p * rtt.size()))] / 1000.0; };
+        std::cout << "ping-pong over " << (cfg.shm ? "shm" : "tcp") << ", " << rtt.size() << " round trips\n";
+        if (rtt.empty()) return 1;
+        std::cout << "round trip  p50 " << pct(0.50) << " us, p99 " << pct(0.99) << " us\n";
+        std::cout << "one way     p50 " << pct(0.50) / 2 << " us, p99 " << pct(0.99) / 2 << " us\n";
+        if (cfg.shm) {
+            uint64_t ringWait[HIST_BUCKETS] = {}, samples = 0;
+            for (int id = 0; id < 2; id++)
+                for (int b = 0; b < HIST_BUCKETS; b++) ringWait[b] += shared->stats[id].ringWait[b];
+            for (uint64_t n : ringWait) samples += n;
+            std::cout << "ring only   p50 " << histogramPercentile(ringWait, 0.50) / 1000.0 << " us, p99 "
+                      << histogramPercentile(ringWait, 0.99) / 1000.0 << " us (" << samples << " samples, "
+                      << shared->stats[0].fromRing + shared->stats[1].fromRing << " SETs applied by the ring reader)\n";
+        }
+        return 0;
+    }
+
+    BenchNodeStats total = {};
+    std::vector<long long> visible;
+    for (int id = 0; id < cfg.nodes; id++) {
+        const BenchNodeStats &st = shared->stats[id];
+        total.reads += st.reads;
+        total.writes += st.writes;
+        total.cas += st.cas;
+        total.casOk += st.casOk;
+        total.messages += st.messages;
+        visible.insert(visible.end(), latencies + (long long)id * BENCH_MAX_SAMPLES,
+                       latencies + (long long)id * BENCH_MAX_SAMPLES + st.samples);
+    }
+    long long ops = total.reads + total.writes + total.cas;
+    long long updates = total.writes + total.cas;
+    std::cout << "nodes " << cfg.nodes << ", vars " << cfg.vars << ", fan-out " << cfg.fanout << ", " << (cfg.shm ? "shm" : "tcp")
+              << ", mix " << cfg.readPct << "/" << 100 - cfg.readPct - cfg.casPct << "/" << cfg.casPct
+              << " read/write/cas, " << cfg.seconds << " s\n";
+    std::cout << "ops       " << ops << " (" << (long long)(ops / (double)cfg.seconds) << " ops/s)\n";
+    std::cout << "reads     " << total.reads << ", writes " << total.writes << ", cas " << total.cas
+              << " (" << total.casOk << " succeeded)\n";
+    std::cout << "messages  " << total.messages << " (" << (ops ? total.messages / (double)ops : 0.0) << " per op, "
+              << (updates ? total.messages / (double)updates : 0.0) << " per update)\n";
+    if (visible.empty()) {
+        std::cout << "visible   no remote updates observed\n";
+    }
+    else {
+        std::sort(visible.begin(), visible.end());
+        auto pct = [&](double p) { return visible[std::min(visible.size() - 1, (size_t)(p * visible.size()))] / 1000.0; };
+        std::cout << "visible   p50 " << pct(0.50) << " us, p99 " << pct(0.99) << " us (" << visible.size() << " samples)\n";
+    }
+    return 0;
+}
+
+static int benchMain(int argc, char* argv[]) {
+    BenchConfig cfg;
+    std::map<std::string, int*> options = {
+        {"--nodes", &cfg.nodes}, {"--vars", &cfg.vars}, {"--fanout", &cfg.fanout},
+        {"--seconds", &cfg.seconds}, {"--reads", &cfg.readPct}, {"--cas", &cfg.casPct},
+        {"--window", &cfg.window}, {"--flush", &cfg.flushUs}, {"--migrate", &cfg.migrate},
+        {"--shm", &cfg.shm}, {"--stats", &cfg.statsMs}, {"--pingpong", &cfg.pingpong},
+        {"--port", &cfg.port}
+    };
+    for (int i = 2; i < argc; i++) {
+        auto it = options.find(argv[i]);
+        if (it == options.end() || i + 1 >= argc) {
+            std::cerr << "Unknown or incomplete option " << argv[i] << "\n";
+            return 1;
+        }
+        *it->second = std::stoi(argv[++i]);
+    }
+    if (cfg.pingpong > 0) cfg.nodes = 2;
+    if (cfg.nodes < 1 || cfg.nodes > BENCH_MAX_NODES || cfg.vars < 1 || cfg.vars > DENSE_VARS ||
+        cfg.fanout < 1 || cfg.fanout > cfg.nodes || cfg.seconds < 1 || cfg.window < 1 ||
+        cfg.readPct < 0 || cfg.casPct < 0 || cfg.readPct + cfg.casPct > 100) {
+        std::cerr << "Invalid benchmark configuration\n";
+        return 1;
+    }
+    return runBenchmark(cfg);
+}
+
+// Self-checks for races and failure paths the demo never hits. `./dsm check` runs each
+// against nodes in this process on localhost ports and reports the ones that fail.
+static bool checkBatchOrdering(int basePort) {
+    const int vars = 20000;
+    std::map<int, std::set<int>> subs;
+    for (int v = 0; v < vars; v++) subs[v] = {0, 1};
+    DsmNode a(0, basePort, subs, nullptr), b(1, basePort, subs, nullptr);
+    a.addPeer(1, "127.0.0.1", basePort);
+    b.addPeer(0, "127.0.0.1", basePort);
+    std::vector<std::pair<int, int>> batch;
+    for (int v = 0; v < vars; v++) batch.push_back(std::make_pair(v, 0));
+    std::atomic<bool> writing(true);
+    std::thread single([&]() {
+        for (int n = 1; writing; n++) a.writeVar(n % vars, -n).get();
+    });
+    for (int round = 1; round <= 50; round++) {
+        for (auto &u : batch) u.second = round;
+        a.writeBatch(batch);
+    }
+    writing = false;
+    single.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    bool ok = true;
+    for (int v = 0; v < vars && ok; v++) ok = a.readVar(v) == b.readVar(v);
+    a.stop();
+    b.stop();
+    return ok;
+}
+
+// Writes whose owner is down or was never added as a peer must fail, not hang.
+static bool checkUnreachableOwner(int basePort) {
+    std::map<int, std::set<int>> subs = {{1, {0, 5}}, {2, {2, 5}}};
+    DsmNode b(5, basePort, subs, nullptr);
+    b.addPeer(0, "127.0.0.1", basePort);    // never started
+    auto down = b.writeVar(1, 5);
+    auto unknown = b.writeVar(2, 5);        // node 2 was never added
+    bool ok = down.wait_for(std::chrono::seconds(2)) == std::future_status::ready && !down.get() &&
+              unknown.wait_for(std::chrono::seconds(2)) == std::future_status::ready && !unknown.get();
+    b.stop();
+    return ok;
+}
+
+// A lease read whose owner accepts the connection but never answers returns -1 once
+// the timeout passes.
+static bool checkLeaseReadTimeout(int basePort) {
+    int silent = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(silent, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(basePort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(silent, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(silent, 4) < 0) {
+        close(silent);
+        return false;
+    }
+    std::map<int, std::set<int>> subs = {{1, {0}}};
+    DsmNode b(5, basePort, subs, nullptr);
+    b.setSharedMemory(false);
+    b.addPeer(0, "127.0.0.1", basePort);
+    auto start = std::chrono::steady_clock::now();
+    int value = b.readVar(1, std::chrono::milliseconds(100), std::chrono::milliseconds(300));
+    auto waited = std::chrono::steady_clock::now() - start;
+    bool ok = value == -1 && waited >= std::chrono::milliseconds(300) && waited < std::chrono::seconds(2);
+    b.stop();
+    close(silent);
+    return ok;
+}
+
+// A node that subscribes after ownership moved learns the new owner from the reply.
+static bool checkSubscribeAfterMigration(int basePort) {
+    std::map<int, std::set<int>> subs = {{1, {0, 1}}};
+    DsmNode a(0, basePort, subs, nullptr), b(1, basePort, subs, nullptr), c(2, basePort, subs, nullptr);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            if (i != j) (i == 0 ? a : i == 1 ? b : c).addPeer(j, "127.0.0.1", basePort);
+    for (int i = 1; i <= 200; i++) b.writeVar(1, i).get();
+    bool ok = b.ownerOf(1) == 1 && c.subscribe(1).get() && c.ownerOf(1) == 1 && c.readVar(1) == 200;
+    ok = ok && c.writeVar(1, 500).get();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ok = ok && a.readVar(1) == 500 && b.readVar(1) == 500 && c.readVar(1) == 500;
+    a.stop();
+    b.stop();
+    c.stop();
+    return ok;
+}
+
+static int checkMain() {
+    verbose = false;
+    std::vector<std::pair<const char*, std::function<bool(int)>>> checks = {
+        {"batch and single writes converge", checkBatchOrdering},
+        {"requests to an unreachable owner fail", checkUnreachableOwner},
+        {"lease reads from an unreachable owner time out", checkLeaseReadTimeout},
+        {"subscribing after a migration finds the new owner", checkSubscribeAfterMigration},
+    };
+    int failed = 0;
+    for (size_t i = 0; i < checks.size(); i++) {
+        bool ok = checks[i].second(7300 + 10 * (int)i);
+        std::cout << (ok ? "ok     " : "FAILED ") << checks[i].first << "\n";
+        if (!ok) failed++;
+    }
+    return failed ? 1 : 0;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "bench") return benchMain(argc, argv);
+    if (argc >= 2 && std::string(argv[1]) == "check") return checkMain();
     if (argc < 2) {
-        std::cerr << "Usage: ./dsm <nodeId>\n";
+        std::cerr << "Usage: ./dsm <nodeId>\n"
+                  << "       ./dsm check\n"
+                  << "       ./dsm bench [--nodes N] [--vars M] [--fanout F] [--seconds S] [--reads PCT] [--cas PCT]\n"
+                  << "                   [--window W] [--flush US] [--migrate WRITES] [--shm 0|1] [--stats MS] [--pingpong ROUNDS] [--port BASE]\n";
         return 1;
     }
     int nodeId = std::stoi(argv[1]);
@@ -391,7 +2138,8 @@ int main(int argc, char* argv[]) {
         std::this_thread::sleep_for(std::chrono::seconds(2));
         node.writeVar(3, 40);
         std::this_thread::sleep_for(std::chrono::seconds(2));
-        node.compareExchange(2, 30, 35);
+        bool swapped = node.compareExchange(2, 30, 35).get();
+        std::cout << "Node 1 CAS var 2 30->35 " << (swapped ? "succeeded" : "failed") << "\n";
     }
     else {
         node.addPeer(0, "127.0.0.1", 5000);
@@ -399,7 +2147,8 @@ int main(int argc, char* argv[]) {
         std::this_thread::sleep_for(std::chrono::seconds(3));
         node.writeVar(4, 50);
         node.writeVar(5, 60);
-        node.compareExchange(4, 50, 55);
+        bool swapped = node.compareExchange(4, 50, 55).get();
+        std::cout << "Node 2 CAS var 4 50->55 " << (swapped ? "succeeded" : "failed") << "\n";
     }
 
     std::cout << "Node " << nodeId << " - press Enter to see final values...\n";
@@ -0,0 +1,1261 @@
+    #pragma once
+    #include <opencv2/opencv.hpp>
+    #include <cmath>
+    #include <vector>
+    #include <thread>
+    #include <numeric>
+    #include <cstdint>
+    #include <deque>
+    #include <functional>
+    #include <memory>
+    #include <mutex>
+    #include <condition_variable>
+    #include <string>
+    #include <algorithm>
+    #include <unordered_map>
+    #include <map>
+    #include <random>
+    #include <array>
+    #include <tuple>
+    #include <type_traits>
+    #include <cstdlib>
+    #include <mpi.h>
+    #if defined(__AVX__) || defined(__SSE2__)
+    #include <immintrin.h>
+    #endif
+
+
+    using namespace std;
+    using namespace cv;
+
+    // Per-dth trig tables shared by every voting backend.
+    // cosQ/sinQ hold cos/dr and sin/dr in fixed point with HOUGH_FRAC_BITS fractional bits.
+    static const int HOUGH_FRAC_BITS = 32;
+
+    struct HoughTables {
+        int nr, nt, d;
+        float dr, dth;
+        bool fixedPoint;
+        int64_t tolUnit;
+        vector<float> cosT, sinT;
+        vector<int64_t> cosQ, sinQ;
+    };
+
+    static HoughTables makeTables(int rows, int cols, float dr, float dth, bool fixedPoint) {
+        HoughTables tab;
+        tab.d = static_cast<int>(ceil(sqrt(rows*rows + cols*cols)));
+        tab.nr = 2*tab.d;
+        tab.nt = static_cast<int>(180.f / dth);
+        tab.dr = dr;
+        tab.dth = dth;
+        tab.fixedPoint = fixedPoint;
+        tab.tolUnit = static_cast<int64_t>((int64_t(1) << (HOUGH_FRAC_BITS - 20)) / min(dr, 1.f)) + 1;
+        tab.cosT.resize(tab.nt); tab.sinT.resize(tab.nt);
+        tab.cosQ.resize(tab.nt); tab.sinQ.resize(tab.nt);
+        const double scale = static_cast<double>(int64_t(1) << HOUGH_FRAC_BITS) / dr;
+        for(int t=0;t<tab.nt;t++){
+            float rad = (t*dth)*CV_PI/180.f;
+            tab.cosT[t] = cos(rad);
+            tab.sinT[t] = sin(rad);
+            tab.cosQ[t] = llround(tab.cosT[t]*scale);
+            tab.sinQ[t] = llround(tab.sinT[t]*scale);
+        }
+        return tab;
+    }
+
+    // The rho kernels round each product before the add, as the SIMD lanes do. Left to itself, the compiler fuses
+    // the scalar x*cos + y*sin into an FMA on FMA targets (GCC does by default with -march=native), which moves a
+    // few bins and makes theta-split results depend on where each thread's SIMD tail falls. Contraction is
+    // therefore switched off for these two functions, whatever -ffp-contract the file is built with.
+    #if defined(__clang__)
+    #define HOUGH_NO_FP_CONTRACT _Pragma("clang fp contract(off)")
+    #else
+    #define HOUGH_NO_FP_CONTRACT
+    #if defined(__GNUC__)
+    #pragma GCC push_options
+    #pragma GCC optimize("fp-contract=off")
+    #endif
+    #endif
+
+    // rho bin of (x, y) for every theta in [t0, t1), vectorized over theta.
+    // cvtps rounds half to even like cvRound, so the bins match the scalar float formula bit for bit.
+    static inline void rhoBinsFloat(const HoughTables &tab, int x, int y, int t0, int t1, int *bins) {
+        HOUGH_NO_FP_CONTRACT
+        int t = t0;
+        const float *c = tab.cosT.data(), *s = tab.sinT.data();
+    #if defined(__AVX__)
+        const __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y), vdr = _mm256_set1_ps(tab.dr);
+        const __m256i vd = _mm256_set1_epi32(tab.d);
+        for(; t+8<=t1; t+=8){
+            __m256 rho = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(vx, _mm256_loadu_ps(c+t)),
+                                                     _mm256_mul_ps(vy, _mm256_loadu_ps(s+t))), vdr);
+            __m256i r = _mm256_cvtps_epi32(rho);
+            __m128i lo = _mm_add_epi32(_mm256_castsi256_si128(r), _mm256_castsi256_si128(vd));
+            __m128i hi = _mm_add_epi32(_mm256_extractf128_si256(r, 1), _mm256_castsi256_si128(vd));
+            _mm_storeu_si128((__m128i*)(bins+t), lo);
+            _mm_storeu_si128((__m128i*)(bins+t+4), hi);
+        }
+    #elif defined(__SSE2__)
+        const __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y), vdr = _mm_set1_ps(tab.dr);
+        const __m128i vd = _mm_set1_epi32(tab.d);
+        for(; t+4<=t1; t+=4){
+            __m128 rho = _mm_div_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(c+t)),
+                                               _mm_mul_ps(vy, _mm_loadu_ps(s+t))), vdr);
+            _mm_storeu_si128((__m128i*)(bins+t), _mm_add_epi32(_mm_cvtps_epi32(rho), vd));
+        }
+    #endif
+        for(; t<t1; t++){
+            bins[t] = cvRound((x*c[t] + y*s[t])/tab.dr) + tab.d;
+        }
+    }
+
+    // Integer-only rho bins. A result whose fraction lies within the float kernel's error bound
+    // of a rounding boundary is recomputed in float, so the accumulator stays identical to it.
+    static inline void rhoBinsFixed(const HoughTables &tab, int x, int y, int t0, int t1, int *bins) {
+        HOUGH_NO_FP_CONTRACT
+        const int64_t one = int64_t(1) << HOUGH_FRAC_BITS, mask = one - 1, tol = (x + y + 1) * tab.tolUnit;
+        const int64_t bias = (int64_t(tab.d) << HOUGH_FRAC_BITS) + (one >> 1);
+        for(int t=t0; t<t1; t++){
+            int64_t q = x*tab.cosQ[t] + y*tab.sinQ[t] + bias;
+            int64_t frac = q & mask;
+            if(frac > tol && frac < one - tol) bins[t] = static_cast<int>(q >> HOUGH_FRAC_BITS);
+            else bins[t] = cvRound((x*tab.cosT[t] + y*tab.sinT[t])/tab.dr) + tab.d;
+        }
+    }
+
+    #if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC pop_options
+    #endif
+
+    // Vote targets: a plain int* is the row-major r*nt + t layout, ColumnTarget is a theta-major HoughAccumulator.
+    template<typename C>
+    struct ColumnTarget {
+        C *data;
+        size_t stride;
+    };
+
+    static inline void bump(int *acc, int r, int t, int nt) { acc[r*nt + t]++; }
+
+    template<typename C>
+    static inline void bump(const ColumnTarget<C> &acc, int r, int t, int) { acc.data[t*acc.stride + r]++; }
+
+    template<typename Acc>
+    static inline void votePoint(const HoughTables &tab, int x, int y, int t0, int t1, int *bins, const Acc &acc) {
+        if(tab.fixedPoint) rhoBinsFixed(tab, x, y, t0, t1, bins);
+        else rhoBinsFloat(tab, x, y, t0, t1, bins);
+        for(int t=t0; t<t1; t++) bump(acc, bins[t], t, tab.nt);
+    }
+
+    template<typename Acc>
+    static inline void votePoint(const HoughTables &tab, int x, int y, int *bins, const Acc &acc) {
+        votePoint(tab, x, y, 0, tab.nt, bins, acc);
+    }
+
+    // Sobel derivatives of the input image for gradient-oriented voting: each edge pixel only votes for
+    // thetas within windowDeg of its gradient direction, which is the normal of the line through it.
+    struct GradientWindow {
+        Mat dx, dy;  // CV_16S
+        float windowDeg = 5.f;
+    };
+
+    static GradientWindow makeGradientWindow(const Mat &img, float windowDeg=5.f) {
+        GradientWindow g;
+        Sobel(img, g.dx, CV_16S, 1, 0, 3);
+        Sobel(img, g.dy, CV_16S, 0, 1, 3);
+        g.windowDeg = windowDeg;
+        return g;
+    }
+
+    static inline int gradientBin(const HoughTables &tab, short gx, short gy) {
+        float deg = atan2((float)gy, (float)gx)*180.f/CV_PI;
+        if(deg < 0) deg += 180.f;
+        return cvRound(deg/tab.dth) % tab.nt;
+    }
+
+    // Votes (x, y) for the bins within halfBins of `center` (wrapping around 180 degrees), clipped to [t0, t1).
+    template<typename Acc>
+    static inline void voteWindow(const HoughTables &tab, int center, int halfBins, int x, int y, int t0, int t1, int *bins, const Acc &acc) {
+        if(2*halfBins + 1 >= tab.nt){
+            votePoint(tab, x, y, t0, t1, bins, acc);
+            return;
+        }
+        auto segment = [&](int a, int b){
+            a = max(a, t0); b = min(b, t1);
+            if(a < b) votePoint(tab, x, y, a, b, bins, acc);
+        };
+        int lo = center - halfBins, hi = center + halfBins + 1;
+        if(lo < 0){ segment(lo + tab.nt, tab.nt); segment(0, hi); }
+        else if(hi > tab.nt){ segment(lo, tab.nt); segment(0, hi - tab.nt); }
+        else segment(lo, hi);
+    }
+
+    // Votes one edge pixel, restricted to its gradient window when `gradient` is set.
+    template<typename Acc>
+    static inline void voteEdge(const HoughTables &tab, const GradientWindow *gradient, int x, int y, int t0, int t1, int *bins, const Acc &acc) {
+        if(!gradient){
+            votePoint(tab, x, y, t0, t1, bins, acc);
+            return;
+        }
+        int center = gradientBin(tab, gradient->dx.ptr<short>(y)[x], gradient->dy.ptr<short>(y)[x]);
+        voteWindow(tab, center, cvCeil(gradient->windowDeg/tab.dth), x, y, t0, t1, bins, acc);
+    }
+
+    template<typename T>
+    struct CacheAlignedAllocator {
+        typedef T value_type;
+        CacheAlignedAllocator() {}
+        template<typename U> CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+        T *allocate(size_t n) {
+            size_t bytes = (n*sizeof(T) + 63) / 64 * 64;
+            void *p = aligned_alloc(64, max<size_t>(bytes, 64));
+            if(!p) throw bad_alloc();
+            return static_cast<T*>(p);
+        }
+        void deallocate(T *p, size_t) { free(p); }
+        template<typename U> bool operator==(const CacheAlignedAllocator<U> &) const { return true; }
+        template<typename U> bool operator!=(const CacheAlignedAllocator<U> &) const { return false; }
+    };
+
+    enum CounterWidth { COUNTER_16, COUNTER_32 };
+
+    // Theta-major accumulator: column t holds the rho bins of one theta, padded to whole cache lines, so a pixel's
+    // neighbours hit the same lines for each theta and a theta range is one contiguous block.
+    // 16-bit counters are promoted to 32 bits before any cell could overflow: a point votes a cell at most once,
+    // so a cell never exceeds the number of points voted since the last exact maximum.
+    class HoughAccumulator {
+        int nr_ = 0, nt_ = 0;
+        size_t stride_ = 0;
+        bool wide_ = false;
+        long long bound_ = 0;
+        vector<uint16_t, CacheAlignedAllocator<uint16_t>> narrow;
+        vector<uint32_t, CacheAlignedAllocator<uint32_t>> wideCells;
+
+    public:
+        void reset(int nr, int nt, CounterWidth width) {
+            nr_ = nr;
+            nt_ = nt;
+            stride_ = (nr + 31) / 32 * 32;
+            wide_ = width == COUNTER_32;
+            bound_ = 0;
+            if(wide_){
+                narrow = decltype(narrow)();
+                wideCells.assign(stride_*nt, 0);
+            } else {
+                wideCells = decltype(wideCells)();
+                narrow.assign(stride_*nt, 0);
+            }
+        }
+
+        int nr() const { return nr_; }
+        int nt() const { return nt_; }
+        size_t stride() const { return stride_; }
+        size_t cells() const { return stride_*nt_; }
+        bool wide() const { return wide_; }
+        void *raw() { return wide_ ? (void*)wideCells.data() : (void*)narrow.data(); }
+
+        // Call before voting `points` more points.
+        void reserveVotes(long long points) {
+            if(!wide_ && bound_ + points > 65535){
+                bound_ = narrow.empty() ? 0 : *max_element(narrow.begin(), narrow.end());
+                if(bound_ + points > 65535){
+                    wideCells.assign(narrow.begin(), narrow.end());
+                    narrow = decltype(narrow)();
+                    wide_ = true;
+                }
+            }
+            bound_ += points;
+        }
+
+        template<typename F>
+        void visit(F &&f) {
+            if(wide_) f(ColumnTarget<uint32_t>{wideCells.data(), stride_});
+            else f(ColumnTarget<uint16_t>{narrow.data(), stride_});
+        }
+
+        int at(int r, int t) const {
+            return wide_ ? (int)wideCells[t*stride_ + r] : (int)narrow[t*stride_ + r];
+        }
+
+        // this[begin, end) += other[begin, end); both must share the shape and this must be reserved for the sum.
+        void addRange(const HoughAccumulator &other, size_t begin, size_t end) {
+            for(size_t i=begin; i<end; i++){
+                uint32_t v = other.wide_ ? other.wideCells[i] : other.narrow[i];
+                if(wide_) wideCells[i] += v;
+                else narrow[i] += static_cast<uint16_t>(v);
+            }
+        }
+
+        // Row-major int copy (r*nt + t) for peak detection and drawing, transposed in theta tiles.
+        void exportRowMajor(vector<int> &acc) const {
+            acc.assign((size_t)nr_*nt_, 0);
+            const int tile = 16;
+            for(int t0=0; t0<nt_; t0+=tile){
+                int t1 = min(nt_, t0 + tile);
+                for(int r=0; r<nr_; r++){
+                    for(int t=t0; t<t1; t++) acc[(size_t)r*nt_ + t] = at(r, t);
+                }
+            }
+        }
+    };
+
+    // Persistent worker pool so the threaded backend does not spawn threads per frame.
+    class HoughThreadPool {
+        vector<thread> workers;
+        deque<function<void()>> tasks;
+        mutex m;
+        condition_variable cv;
+        bool stopping = false;
+
+        void workerLoop() {
+            while(true){
+                function<void()> task;
+                {
+                    unique_lock<mutex> lock(m);
+                    cv.wait(lock, [this]{ return stopping || !tasks.empty(); });
+                    if(stopping && tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit HoughThreadPool(int numThreads) {
+            for(int i=0;i<max(1, numThreads);i++) workers.emplace_back(&HoughThreadPool::workerLoop, this);
+        }
+
+        ~HoughThreadPool() {
+            {
+                lock_guard<mutex> lock(m);
+                stopping = true;
+            }
+            cv.notify_all();
+            for(auto &w : workers) w.join();
+        }
+
+        int size() const { return (int)workers.size(); }
+
+        // Runs body(i) for every i in [0, n) on the pool and waits for those calls only, so
+        // callers on different threads share the workers without waiting on each other's work.
+        void parallelFor(int n, const function<void(int)> &body) {
+            struct Latch {
+                mutex m;
+                condition_variable cv;
+                int left;
+            } latch;
+            latch.left = n;
+            {
+                lock_guard<mutex> lock(m);
+                for(int i=0;i<n;i++) tasks.push_back([&body, &latch, i]{
+                    body(i);
+                    lock_guard<mutex> done(latch.m);
+                    if(--latch.left == 0) latch.cv.notify_all();
+                });
+            }
+            cv.notify_all();
+            unique_lock<mutex> lock(latch.m);
+            latch.cv.wait(lock, [&latch]{ return latch.left == 0; });
+        }
+    };
+
+    // One pool per thread count, kept until exit: a caller still inside parallelFor on one size must not
+    // lose its pool because another thread asked for a different size.
+    static HoughThreadPool &houghPool(int numThreads) {
+        static mutex poolMutex;
+        static map<int, unique_ptr<HoughThreadPool>> pools;
+        lock_guard<mutex> lock(poolMutex);
+        unique_ptr<HoughThreadPool> &pool = pools[max(1, numThreads)];
+        if(!pool) pool.reset(new HoughThreadPool(numThreads));
+        return *pool;
+    }
+
+    // SPLIT_THETA gives each thread a theta range, so threads write disjoint accumulator columns and no merge is needed.
+    // SPLIT_POINTS splits the edge points, votes into per-thread accumulators and merges them tile by tile in parallel.
+    enum HoughSplit { SPLIT_THETA, SPLIT_POINTS };
+
+    static const int VOTE_CHUNK = 4096;
+    static const int THETA_TILE = 16;
+
+    // Votes a run of points over [t0, t1). Without a gradient window the thetas are walked in tiles of THETA_TILE,
+    // so the accumulator columns touched by the run stay cache resident.
+    template<typename Acc>
+    static void voteCoords(const HoughTables &tab, const GradientWindow *gradient, const pair<int,int> *coords, int count,
+                           int t0, int t1, int *bins, const Acc &acc) {
+        if(gradient){
+            for(int i=0;i<count;i++) voteEdge(tab, gradient, coords[i].second, coords[i].first, t0, t1, bins, acc);
+            return;
+        }
+        for(int tt=t0; tt<t1; tt+=THETA_TILE){
+            int te = min(t1, tt + THETA_TILE);
+            for(int i=0;i<count;i++) votePoint(tab, coords[i].second, coords[i].first, tt, te, bins, acc);
+        }
+    }
+
+    static void voteSerial(const Mat &edges, HoughAccumulator &acc, const HoughTables &tab, const GradientWindow *gradient, CounterWidth width) {
+        acc.reset(tab.nr, tab.nt, width);
+        vector<int> bins(tab.nt);
+        vector<pair<int,int>> chunk;
+        chunk.reserve(VOTE_CHUNK);
+        auto flush = [&]{
+            acc.reserveVotes(chunk.size());
+            acc.visit([&](const auto &target){ voteCoords(tab, gradient, chunk.data(), (int)chunk.size(), 0, tab.nt, bins.data(), target); });
+            chunk.clear();
+        };
+        for(int y=0;y<edges.rows;y++){
+            const uchar* rowPtr = edges.ptr<uchar>(y);
+            for(int x=0;x<edges.cols;x++){
+                if(!rowPtr[x]) continue;
+                chunk.push_back({y,x});
+                if((int)chunk.size() == VOTE_CHUNK) flush();
+            }
+        }
+        flush();
+    }
+
+    static void houghSerial(const Mat &edges, vector<int> &acc, int &nr, int &nt, float dr=1.f, float dth=1.f, bool fixedPoint=false, const GradientWindow *gradient=nullptr, CounterWidth width=COUNTER_16) {
+        HoughTables tab = makeTables(edges.rows, edges.cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+        HoughAccumulator votes;
+        voteSerial(edges, votes, tab, gradient, width);
+        votes.exportRowMajor(acc);
+    }
+
+    static void houghThreads(const Mat &edges, vector<int> &acc, int &nr, int &nt, int numThreads=4, float dr=1.f, float dth=1.f, bool fixedPoint=false, HoughSplit split=SPLIT_THETA, const GradientWindow *gradient=nullptr, CounterWidth width=COUNTER_16) {
+        int rows = edges.rows, cols = edges.cols;
+        HoughTables tab = makeTables(rows, cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+        vector<pair<int,int>> coords;
+        coords.reserve(rows*cols);
+        for(int y=0;y<rows;y++){
+            const uchar* rowPtr = edges.ptr<uchar>(y);
+            for(int x=0;x<cols;x++){
+                if(rowPtr[x]) coords.push_back({y,x});
+            }
+        }
+        HoughThreadPool &pool = houghPool(numThreads);
+        int total = (int)coords.size();
+        HoughAccumulator votes;
+        votes.reset(nr, nt, width);
+        votes.reserveVotes(total);
+        if(split == SPLIT_THETA){
+            int parts = min(numThreads, nt);
+            votes.visit([&](const auto &target){
+                pool.parallelFor(parts, [&](int p){
+                    vector<int> bins(nt);
+                    voteCoords(tab, gradient, coords.data(), total, p*nt/parts, (p+1)*nt/parts, bins.data(), target);
+                });
+            });
+            votes.exportRowMajor(acc);
+            return;
+        }
+        // Scratch is reused across calls but owned by the calling thread, so concurrent callers never share it.
+        // Workers must reach it through this reference: naming the thread_local there would give their own copy.
+        thread_local vector<HoughAccumulator> pointScratch;
+        vector<HoughAccumulator> &localAccs = pointScratch;
+        localAccs.resize(numThreads);
+        pool.parallelFor(numThreads, [&](int p){
+            HoughAccumulator &localAcc = localAccs[p];
+            int begin = (int)((long long)p*total/numThreads), end = (int)((long long)(p+1)*total/numThreads);
+            localAcc.reset(nr, nt, width);
+            localAcc.reserveVotes(end - begin);
+            vector<int> bins(nt);
+            localAcc.visit([&](const auto &target){ voteCoords(tab, gradient, coords.data() + begin, end - begin, 0, nt, bins.data(), target); });
+        });
+        const size_t tile = 16384;
+        size_t cells = votes.cells();
+        int tiles = (int)((cells + tile - 1) / tile);
+        pool.parallelFor(tiles, [&](int k){
+            size_t begin = k*tile, end = min(begin + tile, cells);
+            for(auto &localAcc : localAccs) votes.addRange(localAcc, begin, end);
+        });
+        votes.exportRowMajor(acc);
+    }
+
+    // Fused edge-to-vote kernel: the image is cut into tileSize x tileSize tiles, each tile (plus a HOUGH_HALO border
+    // for the Sobel/Canny neighbourhood) is edge-detected and its edge points voted while still in cache.
+    // No full-image edge map or coordinate list is built; each pool worker votes into its own accumulator and the
+    // accumulators are merged tile by tile. Canny hysteresis only follows edges within the halo, so results can
+    // differ from a full-image Canny on a few border pixels. windowDeg > 0 enables gradient-oriented voting.
+    static const int HOUGH_HALO = 8;
+
+    static void houghFused(const Mat &img, vector<int> &acc, int &nr, int &nt, int numThreads=4, double cannyLow=50, double cannyHigh=150,
+                           int tileSize=256, float dr=1.f, float dth=1.f, bool fixedPoint=false, float windowDeg=0.f, CounterWidth width=COUNTER_16) {
+        int rows = img.rows, cols = img.cols;
+        HoughTables tab = makeTables(rows, cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+        vector<Rect> tiles;
+        for(int y=0; y<rows; y+=tileSize){
+            for(int x=0; x<cols; x+=tileSize) tiles.push_back(Rect(x, y, min(tileSize, cols - x), min(tileSize, rows - y)));
+        }
+        HoughThreadPool &pool = houghPool(numThreads);
+        thread_local vector<HoughAccumulator> fusedScratch;
+        vector<HoughAccumulator> &fusedAccs = fusedScratch;
+        fusedAccs.resize(numThreads);
+        vector<long long> points(numThreads, 0);
+        int halfBins = cvCeil(windowDeg/dth);
+        pool.parallelFor(numThreads, [&](int p){
+            HoughAccumulator &localAcc = fusedAccs[p];
+            localAcc.reset(nr, nt, width);
+            vector<int> bins(nt);
+            vector<pair<int,int>> coords;
+            vector<int> centers;
+            Mat dx, dy, edges;
+            for(size_t k=p; k<tiles.size(); k+=numThreads){
+                const Rect &tile = tiles[k];
+                int x0 = max(0, tile.x - HOUGH_HALO), y0 = max(0, tile.y - HOUGH_HALO);
+                int x1 = min(cols, tile.x + tile.width + HOUGH_HALO), y1 = min(rows, tile.y + tile.height + HOUGH_HALO);
+                Mat roi = img(Rect(x0, y0, x1 - x0, y1 - y0));
+                Sobel(roi, dx, CV_16S, 1, 0, 3);
+                Sobel(roi, dy, CV_16S, 0, 1, 3);
+                Canny(dx, dy, edges, cannyLow, cannyHigh);
+                coords.clear();
+                centers.clear();
+                for(int y=tile.y; y<tile.y + tile.height; y++){
+                    const uchar* rowPtr = edges.ptr<uchar>(y - y0);
+                    for(int x=tile.x; x<tile.x + tile.width; x++){
+                        if(!rowPtr[x - x0]) continue;
+                        coords.push_back({y,x});
+                        if(windowDeg > 0) centers.push_back(gradientBin(tab, dx.ptr<short>(y - y0)[x - x0], dy.ptr<short>(y - y0)[x - x0]));
+                    }
+                }
+                localAcc.reserveVotes(coords.size());
+                points[p] += coords.size();
+                localAcc.visit([&](const auto &target){
+                    if(windowDeg <= 0){
+                        voteCoords(tab, nullptr, coords.data(), (int)coords.size(), 0, nt, bins.data(), target);
+                        return;
+                    }
+                    for(size_t i=0; i<coords.size(); i++){
+                        voteWindow(tab, centers[i], halfBins, coords[i].second, coords[i].first, 0, nt, bins.data(), target);
+                    }
+                });
+            }
+        });
+        HoughAccumulator votes;
+        votes.reset(nr, nt, width);
+        votes.reserveVotes(accumulate(points.begin(), points.end(), 0LL));
+        const size_t tile = 16384;
+        size_t cells = votes.cells();
+        int mergeTiles = (int)((cells + tile - 1) / tile);
+        pool.parallelFor(mergeTiles, [&](int k){
+            size_t begin = k*tile, end = min(begin + tile, cells);
+            for(auto &localAcc : fusedAccs) votes.addRange(localAcc, begin, end);
+        });
+        votes.exportRowMajor(acc);
+    }
+
+    // With `gradient` set, rank 0 also broadcasts the gradient bin of every point, so only rank 0 needs the derivatives.
+    // Counters are 16-bit whenever the total number of points fits, which halves the reduction volume.
+    static void houghMPI(const Mat &edges, vector<int> &acc, int &nr, int &nt, float dr=1.f, float dth=1.f, bool fixedPoint=false, const GradientWindow *gradient=nullptr) {
+        int rank, size;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        int rows = edges.rows, cols = edges.cols;
+        HoughTables tab = makeTables(rows, cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+        vector<pair<int,int>> coords;
+        if(rank == 0){
+            coords.reserve(rows*cols);
+            for(int y=0; y<rows; y++){
+                const uchar* rowPtr = edges.ptr<uchar>(y);
+                for(int x=0; x<cols; x++){
+                    if(rowPtr[x]) coords.push_back({y,x});
+                }
+            }
+        }
+        int total = (int)coords.size();
+        MPI_Bcast(&total, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        int chunk = total / size;
+        int start = rank * chunk;
+        int end = (rank == size-1 ? total : (rank+1)*chunk);
+        int windowed = gradient != nullptr;
+        MPI_Bcast(&windowed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        float windowDeg = gradient ? gradient->windowDeg : 0.f;
+        MPI_Bcast(&windowDeg, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        vector<int> xData(total), yData(total), tData(windowed ? total : 0);
+        if(rank == 0){
+            for(int i=0; i<total; i++){
+                xData[i] = coords[i].second;
+                yData[i] = coords[i].first;
+                if(windowed) tData[i] = gradientBin(tab, gradient->dx.ptr<short>(yData[i])[xData[i]], gradient->dy.ptr<short>(yData[i])[xData[i]]);
+            }
+        }
+        MPI_Bcast(xData.data(), total, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(yData.data(), total, MPI_INT, 0, MPI_COMM_WORLD);
+        if(windowed) MPI_Bcast(tData.data(), total, MPI_INT, 0, MPI_COMM_WORLD);
+
+        CounterWidth width = total <= 65535 ? COUNTER_16 : COUNTER_32;
+        HoughAccumulator localAcc, votes;
+        localAcc.reset(nr, nt, width);
+        localAcc.reserveVotes(end - start);
+        vector<int> bins(nt);
+        int halfBins = cvCeil(windowDeg/dth);
+        localAcc.visit([&](const auto &target){
+            for(int i=start; i<end; i++){
+                if(windowed) voteWindow(tab, tData[i], halfBins, xData[i], yData[i], 0, nt, bins.data(), target);
+                else votePoint(tab, xData[i], yData[i], bins.data(), target);
+            }
+        });
+        if(rank == 0) votes.reset(nr, nt, width);
+        MPI_Reduce(localAcc.raw(), rank == 0 ? votes.raw() : nullptr, (int)localAcc.cells(),
+                   width == COUNTER_16 ? MPI_UNSIGNED_SHORT : MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD);
+        if(rank == 0) votes.exportRowMajor(acc);
+        else acc.assign(nr*nt, 0);
+    }
+
+    struct HoughLine {
+        float rho, theta;
+        int votes;
+    };
+
+    struct PeakParams {
+        int threshold = 100;
+        int nmsRadius = 1;  // 0 disables non-maximum suppression
+        int topK = 0;       // 0 keeps every peak
+    };
+
+    // A cell survives suppression if no neighbour within `radius` has more votes; on a plateau
+    // the first cell in (r, t) order wins.
+    template<typename Lookup>
+    static inline bool isLocalMax(int r, int t, int v, int nr, int nt, int radius, const Lookup &at) {
+        for(int rr=max(0, r-radius); rr<=min(nr-1, r+radius); rr++){
+            for(int tt=max(0, t-radius); tt<=min(nt-1, t+radius); tt++){
+                int u = at(rr, tt);
+                bool before = rr < r || (rr == r && tt < t);
+                if(u > v || (u == v && before)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Index of the first cell in row[from, n) above threshold, or n.
+    static inline int nextAbove(const int *row, int from, int n, int threshold) {
+        int i = from;
+    #if defined(__AVX2__)
+        const __m256i vth = _mm256_set1_epi32(threshold);
+        for(; i+8<=n; i+=8){
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(row+i)), vth)));
+            if(mask) return i + __builtin_ctz(mask);
+        }
+    #elif defined(__SSE2__)
+        const __m128i vth = _mm_set1_epi32(threshold);
+        for(; i+4<=n; i+=4){
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(row+i)), vth)));
+            if(mask) return i + __builtin_ctz(mask);
+        }
+    #endif
+        for(; i<n; i++){
+            if(row[i] > threshold) return i;
+        }
+        return n;
+    }
+
+    static void selectTopK(vector<HoughLine> &lines, int topK) {
+        if(topK <= 0) return;
+        stable_sort(lines.begin(), lines.end(), [](const HoughLine &a, const HoughLine &b){ return a.votes > b.votes; });
+        if((int)lines.size() > topK) lines.resize(topK);
+    }
+
+    // Threshold + non-maximum suppression + top-K over the accumulator, split by rho rows across the pool.
+    static vector<HoughLine> findPeaks(const vector<int> &acc, int nr, int nt, const PeakParams &params, int numThreads=4, float dr=1.f, float dth=1.f) {
+        int d = nr/2;
+        int parts = max(1, min(numThreads, nr));
+        vector<vector<HoughLine>> found(parts);
+        auto at = [&](int r, int t){ return acc[r*nt + t]; };
+        houghPool(numThreads).parallelFor(parts, [&](int p){
+            for(int r=p*nr/parts; r<(p+1)*nr/parts; r++){
+                const int *row = acc.data() + (size_t)r*nt;
+                for(int t=nextAbove(row, 0, nt, params.threshold); t<nt; t=nextAbove(row, t+1, nt, params.threshold)){
+                    if(params.nmsRadius > 0 && !isLocalMax(r, t, row[t], nr, nt, params.nmsRadius, at)) continue;
+                    found[p].push_back({(r - d)*dr, static_cast<float>(t*dth*CV_PI/180.f), row[t]});
+                }
+            }
+        });
+        vector<HoughLine> lines;
+        for(auto &part : found) lines.insert(lines.end(), part.begin(), part.end());
+        selectTopK(lines, params.topK);
+        return lines;
+    }
+
+    static void drawLines(Mat &color, const vector<HoughLine> &lines) {
+        for(const HoughLine &l : lines){
+            double a = cos(l.theta), b = sin(l.theta);
+            double x0 = a*l.rho, y0 = b*l.rho;
+            Point pt1, pt2;
+            pt1.x = cvRound(x0 + 1000*(-b));
+            pt1.y = cvRound(y0 + 1000*(a));
+            pt2.x = cvRound(x0 - 1000*(-b));
+            pt2.y = cvRound(y0 - 1000*(a));
+            line(color, pt1, pt2, Scalar(0, 0, 255), 1, LINE_AA);
+        }
+    }
+
+    struct ProgressiveParams {
+        PeakParams peaks;               // topK peaks are tracked between batches; threshold is scaled by the voted fraction
+        double batchFraction = 0.02;    // share of the edge points voted per batch
+        int stableRounds = 3;           // consecutive batches with unchanged peaks before stopping
+        double maxFraction = 1.0;
+        unsigned seed = 42;
+    };
+
+    struct ProgressiveStats {
+        int votedPoints = 0, totalPoints = 0, batches = 0;
+    };
+
+    // Share of `reference` lines that have a match in `approx` within one rho and theta bin.
+    static double peakRecall(const vector<HoughLine> &reference, const vector<HoughLine> &approx, float dr=1.f, float dth=1.f) {
+        if(reference.empty()) return 1.0;
+        const float rhoTol = dr*1.01f, thetaTol = static_cast<float>(dth*CV_PI/180.f)*1.01f;
+        int matched = 0;
+        for(const HoughLine &ref : reference){
+            for(const HoughLine &l : approx){
+                if(fabs(l.rho - ref.rho) <= rhoTol && fabs(l.theta - ref.theta) <= thetaTol){
+                    matched++;
+                    break;
+                }
+            }
+        }
+        return static_cast<double>(matched) / reference.size();
+    }
+
+    // Votes the edge points in random order, batch by batch, and stops once the topK peaks have stayed
+    // in place for stableRounds batches. `acc` holds the partial votes; `lines` the final peaks.
+    static void houghProgressive(const Mat &edges, vector<int> &acc, int &nr, int &nt, vector<HoughLine> &lines,
+                                 const ProgressiveParams &params, ProgressiveStats *stats=nullptr, int numThreads=4,
+                                 float dr=1.f, float dth=1.f, bool fixedPoint=false) {
+        int rows = edges.rows, cols = edges.cols;
+        HoughTables tab = makeTables(rows, cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+        acc.assign(nr*nt, 0);
+        vector<pair<int,int>> coords;
+        for(int y=0;y<rows;y++){
+            const uchar* rowPtr = edges.ptr<uchar>(y);
+            for(int x=0;x<cols;x++){
+                if(rowPtr[x]) coords.push_back({y,x});
+            }
+        }
+        mt19937 gen(params.seed);
+        shuffle(coords.begin(), coords.end(), gen);
+
+        int total = (int)coords.size();
+        int limit = static_cast<int>(ceil(total*min(1.0, params.maxFraction)));
+        int batch = max(1, static_cast<int>(total*params.batchFraction));
+        PeakParams peaks = params.peaks;
+        if(peaks.topK <= 0) peaks.topK = 10;
+        vector<int> bins(nt);
+        vector<HoughLine> previous;
+        int voted = 0, batches = 0, stable = 0;
+        while(voted < limit){
+            int end = min(limit, voted + batch);
+            for(int i=voted; i<end; i++){
+                votePoint(tab, coords[i].second, coords[i].first, bins.data(), acc.data());
+            }
+            voted = end;
+            batches++;
+            peaks.threshold = static_cast<int>(params.peaks.threshold * (double)voted / max(total, 1));
+            lines = findPeaks(acc, nr, nt, peaks, numThreads, dr, dth);
+            bool same = !lines.empty() && lines.size() == previous.size() && peakRecall(previous, lines, dr, dth) == 1.0;
+            stable = same ? stable + 1 : 0;
+            previous = lines;
+            if(stable >= params.stableRounds) break;
+        }
+        if(stats){
+            stats->votedPoints = voted;
+            stats->totalPoints = total;
+            stats->batches = batches;
+        }
+    }
+
+    // Splits rank 0's rows x cols `src` into one row band per rank with MPI_Scatterv.
+    // `bandStart` receives the first image row of this rank's band.
+    static Mat scatterRowBands(const Mat &src, int rows, int cols, int type, MPI_Datatype datatype, int &bandStart) {
+        int rank, size;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        vector<int> counts(size), displs(size);
+        for(int p=0; p<size; p++){
+            int r0 = p*rows/size, r1 = (p+1)*rows/size;
+            counts[p] = (r1 - r0)*cols;
+            displs[p] = r0*cols;
+        }
+        bandStart = rank*rows/size;
+        Mat band((rank+1)*rows/size - bandStart, cols, type);
+        Mat sendBuf = (rank == 0 && !src.isContinuous()) ? src.clone() : src;
+        MPI_Scatterv(rank == 0 ? sendBuf.ptr(0) : nullptr, counts.data(), displs.data(), datatype,
+                     band.empty() ? nullptr : band.ptr(0), counts[rank], datatype, 0, MPI_COMM_WORLD);
+        return band;
+    }
+
+    // Distributed variant of houghMPI: rank 0 scatters row bands of the edge image, every rank extracts
+    // and votes its own edge points, and MPI_Reduce_scatter leaves each rank one block of theta columns.
+    // Only cells above the threshold travel back to rank 0, so traffic no longer grows with edges x ranks.
+    // A cell can only be suppressed by a larger neighbour, which is above the threshold too, so rank 0 can run
+    // non-maximum suppression on the sparse candidates alone.
+    // `edges` (and `gradient`, whose derivative bands are scattered alongside) only have to be valid on rank 0;
+    // `lines` is filled on rank 0.
+    static void houghMPIScatter(const Mat &edges, vector<HoughLine> &lines, const PeakParams &params, int &nr, int &nt, float dr=1.f, float dth=1.f, bool fixedPoint=false, const GradientWindow *gradient=nullptr) {
+        int rank, size;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        int dims[2] = {edges.rows, edges.cols};
+        MPI_Bcast(dims, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        int rows = dims[0], cols = dims[1];
+        HoughTables tab = makeTables(rows, cols, dr, dth, fixedPoint);
+        nr = tab.nr;
+        nt = tab.nt;
+
+        int bandStart;
+        Mat band = scatterRowBands(edges, rows, cols, CV_8UC1, MPI_UNSIGNED_CHAR, bandStart);
+
+        int windowed = gradient != nullptr;
+        MPI_Bcast(&windowed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        GradientWindow bandGradient;
+        if(windowed){
+            bandGradient.windowDeg = rank == 0 ? gradient->windowDeg : 0.f;
+            MPI_Bcast(&bandGradient.windowDeg, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+            bandGradient.dx = scatterRowBands(rank == 0 ? gradient->dx : Mat(), rows, cols, CV_16SC1, MPI_SHORT, bandStart);
+            bandGradient.dy = scatterRowBands(rank == 0 ? gradient->dy : Mat(), rows, cols, CV_16SC1, MPI_SHORT, bandStart);
+        }
+
+        int bandPoints = 0, total = 0;
+        for(int y=0; y<band.rows; y++){
+            const uchar* rowPtr = band.ptr<uchar>(y);
+            for(int x=0; x<cols; x++) bandPoints += rowPtr[x] != 0;
+        }
+        MPI_Allreduce(&bandPoints, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        CounterWidth width = total <= 65535 ? COUNTER_16 : COUNTER_32;
+        HoughAccumulator localAcc;
+        localAcc.reset(nr, nt, width);
+        localAcc.reserveVotes(bandPoints);
+
+        vector<int> bins(nt);
+        int halfBins = cvCeil(bandGradient.windowDeg/dth);
+        localAcc.visit([&](const auto &target){
+            for(int y=0; y<band.rows; y++){
+                const uchar* rowPtr = band.ptr<uchar>(y);
+                for(int x=0; x<cols; x++){
+                    if(!rowPtr[x]) continue;
+                    if(windowed){
+                        int center = gradientBin(tab, bandGradient.dx.ptr<short>(y)[x], bandGradient.dy.ptr<short>(y)[x]);
+                        voteWindow(tab, center, halfBins, x, bandStart + y, 0, nt, bins.data(), target);
+                    } else {
+                        votePoint(tab, x, bandStart + y, bins.data(), target);
+                    }
+                }
+            }
+        });
+
+        size_t stride = localAcc.stride();
+        vector<int> blockCounts(size);
+        for(int p=0; p<size; p++) blockCounts[p] = (int)(((p+1)*nt/size - p*nt/size)*stride);
+        int blockStart = rank*nt/size;
+        vector<int> candidates;
+        localAcc.visit([&](const auto &target){
+            typedef typename remove_reference<decltype(*target.data)>::type Counter;
+            vector<Counter> block(blockCounts[rank]);
+            MPI_Reduce_scatter(target.data, block.data(), blockCounts.data(), width == COUNTER_16 ? MPI_UNSIGNED_SHORT : MPI_UNSIGNED,
+                               MPI_SUM, MPI_COMM_WORLD);
+            for(size_t i=0; i<block.size(); i++){
+                int r = (int)(i % stride);
+                if(r < nr && (int)block[i] > params.threshold){
+                    candidates.push_back(r);
+                    candidates.push_back(blockStart + (int)(i / stride));
+                    candidates.push_back((int)block[i]);
+                }
+            }
+        });
+        int count = (int)candidates.size();
+        vector<int> candidateCounts(size), candidateDispls(size, 0);
+        MPI_Gather(&count, 1, MPI_INT, candidateCounts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        for(int p=1; p<size; p++) candidateDispls[p] = candidateDispls[p-1] + candidateCounts[p-1];
+        vector<int> all(rank == 0 ? candidateDispls[size-1] + candidateCounts[size-1] : 0);
+        MPI_Gatherv(candidates.data(), count, MPI_INT, all.data(), candidateCounts.data(), candidateDispls.data(),
+                    MPI_INT, 0, MPI_COMM_WORLD);
+
+        lines.clear();
+        if(rank != 0) return;
+        vector<array<int,3>> sorted;
+        for(size_t i=0; i+2<all.size(); i+=3) sorted.push_back({all[i], all[i+1], all[i+2]});
+        sort(sorted.begin(), sorted.end());
+        for(size_t i=0; i<sorted.size(); i++) copy(sorted[i].begin(), sorted[i].end(), all.begin() + 3*i);
+        unordered_map<long long, int> cells;
+        for(size_t i=0; i+2<all.size(); i+=3) cells[(long long)all[i]*nt + all[i+1]] = all[i+2];
+        auto at = [&](int r, int t){
+            auto it = cells.find((long long)r*nt + t);
+            return it == cells.end() ? 0 : it->second;
+        };
+        int d = nr/2;
+        for(size_t i=0; i+2<all.size(); i+=3){
+            if(params.nmsRadius > 0 && !isLocalMax(all[i], all[i+1], all[i+2], nr, nt, params.nmsRadius, at)) continue;
+            lines.push_back({(all[i] - d)*dr, static_cast<float>(all[i+1]*dth*CV_PI/180.f), all[i+2]});
+        }
+        selectTopK(lines, params.topK);
+    }
+
+    // Circle and generalized Hough transforms vote into a sparse (a, b, k) space: (a, b) is a centre or reference
+    // point and k a radius or scale index. Every edge pixel votes along its gradient, so votes per pixel are
+    // bounded by the number of radii/scales (times the R-table bin size) instead of the image area.
+    enum ShapeKind { SHAPE_CIRCLE, SHAPE_GENERALIZED };
+
+    struct ShapeTransform {
+        ShapeKind kind = SHAPE_CIRCLE;
+        vector<float> sizes;                 // circle radii or template scales, indexed by k
+        int angleBins = 90;                  // R-table gradient-angle bins over 360 degrees
+        vector<vector<Point>> rTable;        // per angle bin: displacement from edge pixel to reference point
+    };
+
+    static ShapeTransform circleTransform(int minRadius, int maxRadius, int radiusStep=1) {
+        ShapeTransform shape;
+        shape.kind = SHAPE_CIRCLE;
+        for(int r=minRadius; r<=maxRadius; r+=max(1, radiusStep)) shape.sizes.push_back((float)r);
+        return shape;
+    }
+
+    static inline int angleBin(short gx, short gy, int bins) {
+        float a = atan2((float)gy, (float)gx);
+        if(a < 0) a += 2*CV_PI;
+        return min(bins - 1, (int)(a*bins/(2*CV_PI)));
+    }
+
+    // Ballard R-table of a template: the reference point is the centroid of the template's edge pixels.
+    static ShapeTransform generalizedTransform(const Mat &templ, const vector<float> &scales, int angleBins=90, double cannyLow=50, double cannyHigh=150) {
+        ShapeTransform shape;
+        shape.kind = SHAPE_GENERALIZED;
+        shape.sizes = scales;
+        shape.angleBins = angleBins;
+        shape.rTable.assign(angleBins, vector<Point>());
+        Mat dx, dy, edges;
+        Sobel(templ, dx, CV_16S, 1, 0, 3);
+        Sobel(templ, dy, CV_16S, 0, 1, 3);
+        Canny(dx, dy, edges, cannyLow, cannyHigh);
+        long long sx = 0, sy = 0, n = 0;
+        for(int y=0; y<edges.rows; y++){
+            for(int x=0; x<edges.cols; x++){
+                if(edges.ptr<uchar>(y)[x]){ sx += x; sy += y; n++; }
+            }
+        }
+        if(n == 0) return shape;
+        int cx = (int)(sx/n), cy = (int)(sy/n);
+        for(int y=0; y<edges.rows; y++){
+            for(int x=0; x<edges.cols; x++){
+                if(!edges.ptr<uchar>(y)[x]) continue;
+                shape.rTable[angleBin(dx.ptr<short>(y)[x], dy.ptr<short>(y)[x], angleBins)].push_back(Point(cx - x, cy - y));
+            }
+        }
+        return shape;
+    }
+
+    // Open-addressing hash of (a, b, k) -> votes. Voting grows the table, so counts stay exact and every backend
+    // ends with the same cells however the work was split. bound() then keeps memory within `capacity` slots by
+    // dropping cells at or below a rising vote floor; it depends only on the final counts, not on vote order.
+    class SparseHoughAccumulator {
+        static constexpr uint64_t EMPTY = ~0ULL;
+        vector<uint64_t> keys;
+        vector<uint32_t> counts;
+        size_t used = 0, limit;
+        uint32_t floor_ = 0;
+
+        static inline uint64_t mix(uint64_t k) {
+            k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+            k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+            return k ^ (k >> 33);
+        }
+
+        void insert(uint64_t key, uint32_t n) {
+            size_t mask = keys.size() - 1;
+            for(size_t i=mix(key) & mask;; i=(i+1) & mask){
+                if(keys[i] == key){ counts[i] += n; return; }
+                if(keys[i] == EMPTY){ keys[i] = key; counts[i] = n; used++; return; }
+            }
+        }
+
+        // Reinserts the cells above the vote floor into `slots` slots.
+        void rehash(size_t slots) {
+            vector<uint64_t> oldKeys(slots, EMPTY);
+            vector<uint32_t> oldCounts(slots, 0);
+            oldKeys.swap(keys);
+            oldCounts.swap(counts);
+            used = 0;
+            for(size_t i=0; i<oldKeys.size(); i++){
+                if(oldKeys[i] != EMPTY && oldCounts[i] > floor_) insert(oldKeys[i], oldCounts[i]);
+            }
+        }
+
+    public:
+        explicit SparseHoughAccumulator(size_t capacity=1<<20) : limit(1024) {
+            while(limit < capacity) limit <<= 1;
+            keys.assign(min<size_t>(limit, 1<<16), EMPTY);
+            counts.assign(keys.size(), 0);
+        }
+
+        static inline uint64_t key(int a, int b, int k) {
+            return ((uint64_t)k << 40) | ((uint64_t)(uint32_t)b << 20) | (uint64_t)(uint32_t)a;
+        }
+        static inline int keyA(uint64_t key) { return (int)(key & 0xFFFFF); }
+        static inline int keyB(uint64_t key) { return (int)((key >> 20) & 0xFFFFF); }
+        static inline int keyK(uint64_t key) { return (int)(key >> 40); }
+
+        void add(uint64_t key, uint32_t n=1) {
+            if((used + 1)*10 > keys.size()*7) rehash(keys.size()*2);
+            insert(key, n);
+        }
+
+        // Once voting is done: if the table grew past `capacity` slots, raises the vote floor to the lowest value
+        // that leaves at most capacity/2 cells above it and shrinks the table back to `capacity` slots.
+        void bound() {
+            if(keys.size() <= limit) return;
+            vector<uint32_t> live;
+            live.reserve(used);
+            for(size_t i=0; i<keys.size(); i++){
+                if(keys[i] != EMPTY) live.push_back(counts[i]);
+            }
+            size_t keep = limit/2;
+            if(live.size() > keep){
+                nth_element(live.begin(), live.begin() + keep, live.end(), greater<uint32_t>());
+                floor_ = max(floor_, live[keep]);
+            }
+            rehash(limit);
+        }
+
+        uint32_t get(uint64_t key) const {
+            size_t mask = keys.size() - 1;
+            for(size_t i=mix(key) & mask; keys[i] != EMPTY; i=(i+1) & mask){
+                if(keys[i] == key) return counts[i];
+            }
+            return 0;
+        }
+
+        template<typename F>
+        void forEach(F &&f) const {
+            for(size_t i=0; i<keys.size(); i++){
+                if(keys[i] != EMPTY) f(keys[i], counts[i]);
+            }
+        }
+
+        // Grows the table so `cells` cells fit without rehashing. Bulk inserts in another table's slot order must
+        // reserve first: filling a smaller table with the same hash in that order clusters the linear probes.
+        void reserve(size_t cells) {
+            size_t slots = keys.size();
+            while(cells*10 > slots*7) slots <<= 1;
+            if(slots != keys.size()) rehash(slots);
+        }
+
+        void merge(const SparseHoughAccumulator &other) {
+            reserve(used + other.used);
+            other.forEach([this](uint64_t k, uint32_t n){ add(k, n); });
+        }
+
+        size_t size() const { return used; }
+        size_t capacity() const { return limit; }
+        uint32_t pruneFloor() const { return floor_; }
+    };
+
+    // Votes one edge pixel with gradient (gx, gy) into the (a, b, k) space of `shape`.
+    static inline void voteShape(const ShapeTransform &shape, int x, int y, short gx, short gy, int rows, int cols, SparseHoughAccumulator &acc) {
+        auto vote = [&](int a, int b, int k){
+            if(a >= 0 && b >= 0 && a < cols && b < rows) acc.add(SparseHoughAccumulator::key(a, b, k));
+        };
+        if(shape.kind == SHAPE_CIRCLE){
+            float norm = sqrt((float)gx*gx + (float)gy*gy);
+            if(norm == 0) return;
+            float ux = gx/norm, uy = gy/norm;
+            for(int k=0; k<(int)shape.sizes.size(); k++){
+                float r = shape.sizes[k];
+                vote(cvRound(x + r*ux), cvRound(y + r*uy), k);
+                vote(cvRound(x - r*ux), cvRound(y - r*uy), k);
+            }
+            return;
+        }
+        if(gx == 0 && gy == 0) return;
+        const vector<Point> &entries = shape.rTable[angleBin(gx, gy, shape.angleBins)];
+        for(int k=0; k<(int)shape.sizes.size(); k++){
+            float s = shape.sizes[k];
+            for(const Point &d : entries) vote(cvRound(x + s*d.x), cvRound(y + s*d.y), k);
+        }
+    }
+
+    // Edge map plus Sobel derivatives of a grayscale image, as consumed by the shape backends.
+    struct EdgeGradients {
+        Mat edges, dx, dy;
+    };
+
+    static EdgeGradients edgeGradients(const Mat &img, double cannyLow=50, double cannyHigh=150) {
+        EdgeGradients eg;
+        Sobel(img, eg.dx, CV_16S, 1, 0, 3);
+        Sobel(img, eg.dy, CV_16S, 0, 1, 3);
+        Canny(eg.dx, eg.dy, eg.edges, cannyLow, cannyHigh);
+        return eg;
+    }
+
+    static void voteShapeRows(const EdgeGradients &eg, const ShapeTransform &shape, int y0, int y1, int rowOffset, int rows,
+                              SparseHoughAccumulator &acc) {
+        for(int y=y0; y<y1; y++){
+            const uchar* rowPtr = eg.edges.ptr<uchar>(y);
+            const short *gx = eg.dx.ptr<short>(y), *gy = eg.dy.ptr<short>(y);
+            for(int x=0; x<eg.edges.cols; x++){
+                if(rowPtr[x]) voteShape(shape, x, y + rowOffset, gx[x], gy[x], rows, eg.edges.cols, acc);
+            }
+        }
+    }
+
+    static void shapeSerial(const EdgeGradients &eg, const ShapeTransform &shape, SparseHoughAccumulator &acc) {
+        voteShapeRows(eg, shape, 0, eg.edges.rows, 0, eg.edges.rows, acc);
+        acc.bound();
+    }
+
+    // Row bands on the pool, one exact sparse accumulator per worker, merged into `acc` and bounded once.
+    static void shapeThreads(const EdgeGradients &eg, const ShapeTransform &shape, SparseHoughAccumulator &acc, int numThreads=4) {
+        int rows = eg.edges.rows;
+        vector<SparseHoughAccumulator> locals(numThreads);
+        houghPool(numThreads).parallelFor(numThreads, [&](int p){
+            voteShapeRows(eg, shape, p*rows/numThreads, (p+1)*rows/numThreads, 0, rows, locals[p]);
+        });
+        for(auto &local : locals) acc.merge(local);
+        acc.bound();
+    }
+
+    // Row bands of the edge map and derivatives are scattered from rank 0; each rank votes its band and the
+    // sparse (key, votes) cells are gathered and merged on rank 0. `eg` only has to be valid on rank 0.
+    static void shapeMPI(const EdgeGradients &eg, const ShapeTransform &shape, SparseHoughAccumulator &acc) {
+        int rank, size;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        int dims[2] = {eg.edges.rows, eg.edges.cols};
+        MPI_Bcast(dims, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        int rows = dims[0], cols = dims[1], bandStart;
+        EdgeGradients band;
+        band.edges = scatterRowBands(eg.edges, rows, cols, CV_8UC1, MPI_UNSIGNED_CHAR, bandStart);
+        band.dx = scatterRowBands(eg.dx, rows, cols, CV_16SC1, MPI_SHORT, bandStart);
+        band.dy = scatterRowBands(eg.dy, rows, cols, CV_16SC1, MPI_SHORT, bandStart);
+
+        SparseHoughAccumulator local;
+        SparseHoughAccumulator &target = rank == 0 ? acc : local;
+        voteShapeRows(band, shape, 0, band.edges.rows, bandStart, rows, target);
+
+        vector<uint64_t> cells;
+        if(rank != 0){
+            local.forEach([&](uint64_t k, uint32_t n){ cells.push_back(k); cells.push_back(n); });
+        }
+        int count = (int)cells.size();
+        vector<int> cellCounts(size), cellDispls(size, 0);
+        MPI_Gather(&count, 1, MPI_INT, cellCounts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        for(int p=1; p<size; p++) cellDispls[p] = cellDispls[p-1] + cellCounts[p-1];
+        vector<uint64_t> all(rank == 0 ? cellDispls[size-1] + cellCounts[size-1] : 0);
+        MPI_Gatherv(cells.data(), count, MPI_UINT64_T, all.data(), cellCounts.data(), cellDispls.data(),
+                    MPI_UINT64_T, 0, MPI_COMM_WORLD);
+        if(rank == 0) acc.reserve(acc.size() + all.size()/2);
+        for(size_t i=0; i+1<all.size(); i+=2) acc.add(all[i], (uint32_t)all[i+1]);
+        if(rank == 0) acc.bound();
+    }
+
+    struct HoughShape {
+        float x, y, size;
+        int votes;
+    };
+
+    // Cells above threshold that are maximal within nmsRadius in (a, b) and one step in k; strongest first.
+    static vector<HoughShape> findShapes(const SparseHoughAccumulator &acc, const ShapeTransform &shape, int threshold, int nmsRadius=3, int topK=0) {
+        vector<HoughShape> shapes;
+        acc.forEach([&](uint64_t key, uint32_t v){
+            if((int)v <= threshold) return;
+            int a = SparseHoughAccumulator::keyA(key), b = SparseHoughAccumulator::keyB(key), k = SparseHoughAccumulator::keyK(key);
+            for(int kk=max(0, k-1); kk<=min((int)shape.sizes.size()-1, k+1); kk++){
+                for(int bb=max(0, b-nmsRadius); bb<=b+nmsRadius; bb++){
+                    for(int aa=max(0, a-nmsRadius); aa<=a+nmsRadius; aa++){
+                        uint32_t u = acc.get(SparseHoughAccumulator::key(aa, bb, kk));
+                        bool before = make_tuple(kk, bb, aa) < make_tuple(k, b, a);
+                        if(u > v || (u == v && before)) return;
+                    }
+                }
+            }
+            shapes.push_back({(float)a, (float)b, shape.sizes[k], (int)v});
+        });
+        sort(shapes.begin(), shapes.end(), [](const HoughShape &l, const HoughShape &r){
+            return make_tuple(-l.votes, l.size, l.y, l.x) < make_tuple(-r.votes, r.size, r.y, r.x);
+        });
+        if(topK > 0 && (int)shapes.size() > topK) shapes.resize(topK);
+        return shapes;
+    }
+
+    // Library entry point: every line backend behind one call, selected at run time.
+    enum HoughBackend { BACKEND_SERIAL, BACKEND_THREADS, BACKEND_FUSED, BACKEND_MPI, BACKEND_COUNT };
+    static const char *backendNames[BACKEND_COUNT] = {"serial", "threads", "fused", "mpi"};
+
+    static bool parseBackend(const string &name, HoughBackend &backend) {
+        for(int b=0; b<BACKEND_COUNT; b++){
+            if(name == backendNames[b]){ backend = (HoughBackend)b; return true; }
+        }
+        return false;
+    }
+
+    struct HoughOptions {
+        HoughBackend backend = BACKEND_THREADS;
+        int numThreads = 4;
+        float dr = 1.f, dth = 1.f;
+        bool fixedPoint = false;
+        HoughSplit split = SPLIT_THETA;
+        CounterWidth width = COUNTER_16;
+        float windowDeg = 0.f;               // > 0 votes only within +-windowDeg of the gradient direction
+        double cannyLow = 50, cannyHigh = 150;
+        int tileSize = 256;                  // BACKEND_FUSED only
+    };
+
+    // Canny edges of a grayscale image, as voted by every backend except BACKEND_FUSED.
+    static Mat houghEdges(const Mat &img, const HoughOptions &opts) {
+        Mat edges;
+        Canny(img, edges, opts.cannyLow, opts.cannyHigh);
+        return edges;
+    }
+
+    // Votes a precomputed edge map. `img` is only read for gradient windows and by BACKEND_FUSED, which does its own
+    // edge detection. BACKEND_MPI is collective: every rank must call it, and `acc` is only filled on rank 0.
+    static void houghTransform(const Mat &img, const Mat &edges, vector<int> &acc, int &nr, int &nt, const HoughOptions &opts) {
+        GradientWindow window;
+        const GradientWindow *gradient = nullptr;
+        if(opts.windowDeg > 0 && opts.backend != BACKEND_FUSED){
+            window = makeGradientWindow(img, opts.windowDeg);
+            gradient = &window;
+        }
+        switch(opts.backend){
+        case BACKEND_SERIAL:
+            houghSerial(edges, acc, nr, nt, opts.dr, opts.dth, opts.fixedPoint, gradient, opts.width);
+            break;
+        case BACKEND_THREADS:
+            houghThreads(edges, acc, nr, nt, opts.numThreads, opts.dr, opts.dth, opts.fixedPoint, opts.split, gradient, opts.width);
+            break;
+        case BACKEND_FUSED:
+            houghFused(img, acc, nr, nt, opts.numThreads, opts.cannyLow, opts.cannyHigh, opts.tileSize, opts.dr, opts.dth,
+                       opts.fixedPoint, opts.windowDeg, opts.width);
+            break;
+        default:
+            houghMPI(edges, acc, nr, nt, opts.dr, opts.dth, opts.fixedPoint, gradient);
+            break;
+        }
+    }
+
+    static void houghTransform(const Mat &img, vector<int> &acc, int &nr, int &nt, const HoughOptions &opts) {
+        houghTransform(img, opts.backend == BACKEND_FUSED ? Mat() : houghEdges(img, opts), acc, nr, nt, opts);
+    }
+
+    // Detected lines of a grayscale image. BACKEND_MPI runs houghMPIScatter, so peaks are found on distributed
+    // accumulator slices and only rank 0 gets the lines.
+    static vector<HoughLine> houghLines(const Mat &img, const HoughOptions &opts, const PeakParams &peaks) {
+        vector<HoughLine> lines;
+        int nr, nt;
+        if(opts.backend == BACKEND_MPI){
+            GradientWindow window;
+            if(opts.windowDeg > 0) window = makeGradientWindow(img, opts.windowDeg);
+            houghMPIScatter(houghEdges(img, opts), lines, peaks, nr, nt, opts.dr, opts.dth, opts.fixedPoint,
+                            opts.windowDeg > 0 ? &window : nullptr);
+            return lines;
+        }
+        vector<int> acc;
+        houghTransform(img, acc, nr, nt, opts);
+        return findPeaks(acc, nr, nt, peaks, opts.numThreads, opts.dr, opts.dth);
+    }
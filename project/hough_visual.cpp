@@ -1,159 +1,606 @@
-    #include <opencv2/opencv.hpp>
-    #include <cmath>
-    #include <vector>
-    #include <thread>
-    #include <future>
-    #include <numeric>
-    #include <mpi.h>
-
-
-    using namespace std;
-    using namespace cv;
-
-    static void houghSerial(const Mat &edges, vector<int> &acc, int &nr, int &nt, float dr=1.f, float dth=1.f) {
-        int rows = edges.rows, cols = edges.cols;
-        int d = static_cast<int>(ceil(sqrt(rows*rows + cols*cols)));
-        nr = 2*d;
-        nt = static_cast<int>(180.f / dth);
-        acc.assign(nr*nt, 0);
-        for(int y=0;y<rows;y++){
-            const uchar* rowPtr = edges.ptr<uchar>(y);
-            for(int x=0;x<cols;x++){
-                if(rowPtr[x]){
-                    for(int t=0;t<nt;t++){
-                        float rad = (t*dth)*CV_PI/180.f;
-                        int r = cvRound((x*cos(rad) + y*sin(rad))/dr) + d;
-                        acc[r*nt + t]++;
-                    }
-                }
-            }
+    #include "hough.hpp"
+    #include <chrono>
+    #include <filesystem>
+    #include <cstring>
+    #include <map>
+    #include <atomic>
+    #ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #endif
+
+
+    // Hardware cache-miss counter of the calling thread; stop() returns -1 when perf events are unavailable.
+    class CacheMissCounter {
+        int fd = -1;
+
+    public:
+        CacheMissCounter() {
+    #ifdef __linux__
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    #endif
         }
-    }
 
-    static void houghThreads(const Mat &edges, vector<int> &acc, int &nr, int &nt, int numThreads=4, float dr=1.f, float dth=1.f) {
-        int rows = edges.rows, cols = edges.cols;
-        int d = static_cast<int>(ceil(sqrt(rows*rows + cols*cols)));
-        nr = 2*d;
-        nt = static_cast<int>(180.f / dth);
-        acc.assign(nr*nt, 0);
+        ~CacheMissCounter() {
+    #ifdef __linux__
+            if(fd >= 0) close(fd);
+    #endif
+        }
+
+        void start() {
+    #ifdef __linux__
+            if(fd < 0) return;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    #endif
+        }
+
+        long long stop() {
+    #ifdef __linux__
+            long long count = 0;
+            if(fd < 0) return -1;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if(read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+            return count;
+    #else
+            return -1;
+    #endif
+        }
+    };
+
+    // Serial voting with the legacy row-major int accumulator vs the theta-major HoughAccumulator at both widths.
+    static void benchAccumulator(const Mat &edges, int repeats=5) {
+        HoughTables tab = makeTables(edges.rows, edges.cols, 1.f, 1.f, false);
         vector<pair<int,int>> coords;
-        coords.reserve(rows*cols);
-        for(int y=0;y<rows;y++){
+        for(int y=0;y<edges.rows;y++){
             const uchar* rowPtr = edges.ptr<uchar>(y);
-            for(int x=0;x<cols;x++){
+            for(int x=0;x<edges.cols;x++){
                 if(rowPtr[x]) coords.push_back({y,x});
             }
         }
-        vector<future<vector<int>>> futures;
-        int chunk = max(1, (int)coords.size() / numThreads);
-        auto worker = [&](int start, int end){
-            vector<int> localAcc(nr*nt, 0);
-            for(int i=start;i<end;i++){
-                int y = coords[i].first, x = coords[i].second;
-                for(int t=0;t<nt;t++){
-                    float rad = (t*dth)*CV_PI/180.f;
-                    int r = cvRound((x*cos(rad) + y*sin(rad))/dr) + d;
-                    localAcc[r*nt + t]++;
-                }
-            }
-            return localAcc;
+        long long votes = (long long)coords.size()*tab.nt*repeats;
+        auto report = [&](const char *name, const function<void()> &run){
+            CacheMissCounter counter;
+            auto t0 = chrono::steady_clock::now();
+            counter.start();
+            for(int i=0;i<repeats;i++) run();
+            long long misses = counter.stop();
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / repeats;
+            cout << "  " << name << ": " << ms << " ms, cache misses/vote: ";
+            if(misses < 0) cout << "n/a (perf events unavailable)";
+            else cout << (double)misses / max(votes, 1LL);
+            cout << endl;
         };
-        for(int i=0; i<(int)coords.size(); i+=chunk){
-            futures.push_back(async(std::launch::async, worker, i, min(i+chunk, (int)coords.size())));
+        cout << "Accumulator benchmark: " << coords.size() << " edge points, " << tab.nr << "x" << tab.nt << " cells" << endl;
+        report("row-major int32", [&]{
+            vector<int> acc(tab.nr*tab.nt, 0), bins(tab.nt);
+            for(auto &c : coords) votePoint(tab, c.second, c.first, bins.data(), acc.data());
+        });
+        report("theta-major uint32", [&]{
+            HoughAccumulator acc;
+            voteSerial(edges, acc, tab, nullptr, COUNTER_32);
+        });
+        report("theta-major uint16", [&]{
+            HoughAccumulator acc;
+            voteSerial(edges, acc, tab, nullptr, COUNTER_16);
+        });
+    }
+
+    // Times OpenCV's HoughCircles against the sparse circle engine on each backend and counts matching circles.
+    // Both sides detect edges with opts' Canny thresholds; the threaded engine uses opts.numThreads.
+    static void benchCircles(const Mat &img, int minRadius, int maxRadius, int threshold, const HoughOptions &opts) {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        typedef chrono::steady_clock clock;
+        auto ms = [](clock::time_point since){ return chrono::duration<double, milli>(clock::now() - since).count(); };
+        ShapeTransform shape = circleTransform(minRadius, maxRadius);
+        vector<Vec3f> reference;
+        EdgeGradients eg;
+        if(rank == 0){
+            auto t0 = clock::now();
+            Mat blurred;
+            GaussianBlur(img, blurred, Size(5, 5), 1.5);
+            HoughCircles(blurred, reference, HOUGH_GRADIENT, 1, 2*minRadius, opts.cannyHigh, threshold, minRadius, maxRadius);
+            cout << "  OpenCV HoughCircles: " << ms(t0) << " ms, " << reference.size() << " circles" << endl;
+            eg = edgeGradients(img, opts.cannyLow, opts.cannyHigh);
         }
-        for(auto &f : futures){
-            vector<int> part = f.get();
-            for(size_t i=0; i<acc.size(); i++){
-                acc[i] += part[i];
+        auto report = [&](const char *name, const SparseHoughAccumulator &acc, double elapsed){
+            vector<HoughShape> found = findShapes(acc, shape, threshold);
+            int matched = 0;
+            for(const Vec3f &c : reference){
+                for(const HoughShape &f : found){
+                    if(fabs(f.x - c[0]) <= 3 && fabs(f.y - c[1]) <= 3 && fabs(f.size - c[2]) <= 3){ matched++; break; }
+                }
             }
+            cout << "  " << name << ": " << elapsed << " ms, " << found.size() << " circles, " << matched << "/" << reference.size()
+                 << " match OpenCV, " << acc.size() << " cells" << endl;
+        };
+        if(rank == 0){
+            SparseHoughAccumulator serial, threaded;
+            auto t0 = clock::now();
+            shapeSerial(eg, shape, serial);
+            report("sparse serial", serial, ms(t0));
+            t0 = clock::now();
+            shapeThreads(eg, shape, threaded, opts.numThreads);
+            report("sparse threads", threaded, ms(t0));
         }
+        SparseHoughAccumulator distributed;
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto t0 = clock::now();
+        shapeMPI(eg, shape, distributed);
+        if(rank == 0) report("sparse MPI", distributed, ms(t0));
     }
 
-    static void houghMPI(const Mat &edges, vector<int> &acc, int &nr, int &nt, float dr=1.f, float dth=1.f) {
-        int rank, size;
+    // Times the generalized (R-table) transform of `templ` on each shape backend over `img` and checks the threaded
+    // and MPI accumulators against serial. A location needs half the template's edge pixels to count as a match.
+    static void benchGeneralized(const Mat &img, const Mat &templ, const HoughOptions &opts) {
+        int rank;
         MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-        MPI_Comm_size(MPI_COMM_WORLD, &size);
-        int rows = edges.rows, cols = edges.cols;
-        int d = static_cast<int>(ceil(sqrt(rows*rows + cols*cols)));
-        nr = 2*d;
-        nt = static_cast<int>(180.f / dth);
-        acc.assign(nr*nt, 0);
-        vector<pair<int,int>> coords;
+        typedef chrono::steady_clock clock;
+        auto ms = [](clock::time_point since){ return chrono::duration<double, milli>(clock::now() - since).count(); };
+        ShapeTransform shape = generalizedTransform(templ, {0.9f, 1.f, 1.1f}, 90, opts.cannyLow, opts.cannyHigh);
+        size_t entries = 0;
+        for(const auto &bin : shape.rTable) entries += bin.size();
+        int threshold = (int)entries/2;
+        EdgeGradients eg;
         if(rank == 0){
-            coords.reserve(rows*cols);
-            for(int y=0; y<rows; y++){
-                const uchar* rowPtr = edges.ptr<uchar>(y);
-                for(int x=0; x<cols; x++){
-                    if(rowPtr[x]) coords.push_back({y,x});
-                }
-            }
+            cout << "  R-table: " << entries << " edge pixels, threshold " << threshold << endl;
+            eg = edgeGradients(img, opts.cannyLow, opts.cannyHigh);
         }
-        int total = (int)coords.size();
-        MPI_Bcast(&total, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        int chunk = total / size;
-        int start = rank * chunk;
-        int end = (rank == size-1 ? total : (rank+1)*chunk);
-        vector<int> xData(total), yData(total);
+        map<uint64_t, uint32_t> reference;
+        auto report = [&](const char *name, const SparseHoughAccumulator &acc, double elapsed){
+            map<uint64_t, uint32_t> cells;
+            acc.forEach([&](uint64_t k, uint32_t n){ cells[k] = n; });
+            if(reference.empty()) reference = cells;
+            vector<HoughShape> found = findShapes(acc, shape, threshold, 3, 5);
+            cout << "  " << name << ": " << elapsed << " ms, " << found.size() << " matches, "
+                 << (cells == reference ? "matches serial" : "differs from serial") << endl;
+            for(const HoughShape &f : found) cout << "    (" << f.x << ", " << f.y << ") scale " << f.size << ", " << f.votes << " votes" << endl;
+        };
         if(rank == 0){
-            for(int i=0; i<total; i++){
-                xData[i] = coords[i].second;
-                yData[i] = coords[i].first;
+            SparseHoughAccumulator serial, threaded;
+            auto t0 = clock::now();
+            shapeSerial(eg, shape, serial);
+            report("generalized serial", serial, ms(t0));
+            t0 = clock::now();
+            shapeThreads(eg, shape, threaded, opts.numThreads);
+            report("generalized threads", threaded, ms(t0));
+        }
+        SparseHoughAccumulator distributed;
+        MPI_Barrier(MPI_COMM_WORLD);
+        auto t0 = clock::now();
+        shapeMPI(eg, shape, distributed);
+        if(rank == 0) report("generalized MPI", distributed, ms(t0));
+    }
+
+    // Calls houghTransform from `callers` threads at once, mixing the threads (theta and points split) and fused
+    // backends with thread counts 1..5, and checks each result against the same backend called alone.
+    // Returns the number of calls whose accumulator differed.
+    static int checkConcurrent(const Mat &img, const HoughOptions &opts, int callers=4, int rounds=20) {
+        const HoughBackend backends[] = {BACKEND_THREADS, BACKEND_THREADS, BACKEND_FUSED};
+        const HoughSplit splits[] = {SPLIT_THETA, SPLIT_POINTS, SPLIT_THETA};
+        auto variant = [&](int v, int numThreads){
+            HoughOptions o = opts;
+            o.backend = backends[v];
+            o.split = splits[v];
+            o.numThreads = numThreads;
+            return o;
+        };
+        vector<int> reference[3];
+        for(int v=0; v<3; v++){
+            int nr, nt;
+            houghTransform(img, reference[v], nr, nt, variant(v, opts.numThreads));
+        }
+        atomic<int> mismatches{0};
+        vector<thread> threads;
+        for(int c=0; c<callers; c++){
+            threads.emplace_back([&, c]{
+                for(int i=0; i<rounds; i++){
+                    int v = (c + i) % 3, nr, nt;
+                    vector<int> acc;
+                    houghTransform(img, acc, nr, nt, variant(v, 1 + (c + 2*i) % 5));
+                    if(acc != reference[v]) mismatches++;
+                }
+            });
+        }
+        for(auto &t : threads) t.join();
+        return mismatches;
+    }
+
+    // Blocking queue with a fixed capacity; pop() returns false once the queue is closed and drained.
+    template<typename T>
+    class BoundedQueue {
+        deque<T> items;
+        size_t capacity;
+        bool closed = false;
+        mutex m;
+        condition_variable notEmpty, notFull;
+
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+        void push(T item) {
+            unique_lock<mutex> lock(m);
+            notFull.wait(lock, [this]{ return items.size() < capacity; });
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+        }
+
+        bool pop(T &item) {
+            unique_lock<mutex> lock(m);
+            notEmpty.wait(lock, [this]{ return closed || !items.empty(); });
+            if(items.empty()) return false;
+            item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            lock_guard<mutex> lock(m);
+            closed = true;
+            notEmpty.notify_all();
+        }
+    };
+
+    enum PipelineStage { STAGE_DECODE, STAGE_CANNY, STAGE_VOTE, STAGE_PEAKS, STAGE_OUTPUT, STAGE_COUNT };
+    static const char *stageNames[STAGE_COUNT] = {"decode", "canny", "vote", "peaks", "output"};
+
+    struct PipelineFrame {
+        int index;
+        string name;
+        Mat img, edges;
+        vector<int> acc;
+        int nr, nt;
+        vector<HoughLine> lines;
+        chrono::steady_clock::time_point created;
+        double stageMs[STAGE_COUNT];
+    };
+
+    // Runs decode -> Canny -> vote -> peaks -> output as concurrent stages over a directory of images or a video file.
+    // Runs on one rank only, so opts.backend must not be BACKEND_MPI. The fused backend skips the Canny stage.
+    static void runPipeline(const string &input, const string &outDir, const HoughOptions &opts, const PeakParams &peaks,
+                            size_t queueDepth=4) {
+        typedef chrono::steady_clock clock;
+        auto elapsedMs = [](clock::time_point since){ return chrono::duration<double, milli>(clock::now() - since).count(); };
+        BoundedQueue<PipelineFrame> decoded(queueDepth), edged(queueDepth), voted(queueDepth), peaked(queueDepth);
+        filesystem::create_directories(outDir);
+
+        auto start = clock::now();
+        thread decoder([&]{
+            int index = 0;
+            auto emit = [&](Mat img, const string &name, clock::time_point t0){
+                PipelineFrame f;
+                f.index = index++;
+                f.name = name;
+                f.img = img;
+                f.created = t0;
+                f.stageMs[STAGE_DECODE] = elapsedMs(t0);
+                decoded.push(std::move(f));
+            };
+            if(filesystem::is_directory(input)){
+                vector<string> files;
+                for(const auto &entry : filesystem::directory_iterator(input)){
+                    string ext = entry.path().extension().string();
+                    if(ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp") files.push_back(entry.path().string());
+                }
+                sort(files.begin(), files.end());
+                for(const string &file : files){
+                    auto t0 = clock::now();
+                    Mat img = imread(file, IMREAD_GRAYSCALE);
+                    if(img.empty()) continue;
+                    emit(img, filesystem::path(file).stem().string(), t0);
+                }
+            } else {
+                VideoCapture cap(input);
+                while(cap.isOpened()){
+                    auto t0 = clock::now();
+                    Mat frame, gray;
+                    if(!cap.read(frame)) break;
+                    if(frame.channels() == 3) cvtColor(frame, gray, COLOR_BGR2GRAY);
+                    else gray = frame;
+                    emit(gray, "frame" + to_string(index), t0);
+                }
+            }
+            decoded.close();
+        });
+        thread edger([&]{
+            PipelineFrame f;
+            while(decoded.pop(f)){
+                auto t0 = clock::now();
+                if(opts.backend != BACKEND_FUSED) f.edges = houghEdges(f.img, opts);
+                f.stageMs[STAGE_CANNY] = elapsedMs(t0);
+                edged.push(std::move(f));
             }
+            edged.close();
+        });
+        thread voter([&]{
+            PipelineFrame f;
+            while(edged.pop(f)){
+                auto t0 = clock::now();
+                houghTransform(f.img, f.edges, f.acc, f.nr, f.nt, opts);
+                f.stageMs[STAGE_VOTE] = elapsedMs(t0);
+                voted.push(std::move(f));
+            }
+            voted.close();
+        });
+        thread peaker([&]{
+            PipelineFrame f;
+            while(voted.pop(f)){
+                auto t0 = clock::now();
+                f.lines = findPeaks(f.acc, f.nr, f.nt, peaks, opts.numThreads, opts.dr, opts.dth);
+                f.acc = vector<int>();
+                f.stageMs[STAGE_PEAKS] = elapsedMs(t0);
+                peaked.push(std::move(f));
+            }
+            peaked.close();
+        });
+
+        int frames = 0;
+        double stageTotal[STAGE_COUNT] = {0}, latencyTotal = 0;
+        PipelineFrame f;
+        while(peaked.pop(f)){
+            auto t0 = clock::now();
+            Mat color; cvtColor(f.img, color, COLOR_GRAY2BGR);
+            drawLines(color, f.lines);
+            imwrite((filesystem::path(outDir) / (f.name + "_hough.png")).string(), color);
+            f.stageMs[STAGE_OUTPUT] = elapsedMs(t0);
+            for(int s=0; s<STAGE_COUNT; s++) stageTotal[s] += f.stageMs[s];
+            latencyTotal += elapsedMs(f.created);
+            frames++;
         }
-        MPI_Bcast(xData.data(), total, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Bcast(yData.data(), total, MPI_INT, 0, MPI_COMM_WORLD);
-        vector<int> localAcc(nr*nt, 0);
-        for(int i=start; i<end; i++){
-            int x = xData[i], y = yData[i];
-            for(int t=0; t<nt; t++){
-                float rad = (t*dth)*CV_PI/180.f;
-                int r = cvRound((x*cos(rad) + y*sin(rad))/dr) + d;
-                localAcc[r*nt + t]++;
+        decoder.join(); edger.join(); voter.join(); peaker.join();
+
+        double seconds = chrono::duration<double>(clock::now() - start).count();
+        cout << "Processed " << frames << " frames in " << seconds << " s (" << (seconds > 0 ? frames/seconds : 0) << " fps)" << endl;
+        if(frames == 0) return;
+        for(int s=0; s<STAGE_COUNT; s++){
+            cout << "  " << stageNames[s] << ": " << stageTotal[s]/frames << " ms/frame" << endl;
+        }
+        cout << "  end-to-end latency: " << latencyTotal/frames << " ms/frame" << endl;
+    }
+
+    // Times every backend on each test*.png/jpg in `dir` and checks its accumulator against houghSerial.
+    // Collective, so the MPI backend can take part; only rank 0 prints. Every backend but fused gets a
+    // precomputed edge map, so the fused time includes Canny and its border pixels may differ slightly.
+    static void runBenchmark(const string &dir, HoughOptions opts, int repeats=3) {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        typedef chrono::steady_clock clock;
+        vector<string> files;
+        for(const auto &entry : filesystem::directory_iterator(dir)){
+            string name = entry.path().filename().string(), ext = entry.path().extension().string();
+            if(name.rfind("test", 0) == 0 && (ext == ".png" || ext == ".jpg")) files.push_back(entry.path().string());
+        }
+        sort(files.begin(), files.end());
+        if(rank == 0 && files.empty()) cerr << "No test*.png/jpg images in " << dir << endl;
+
+        for(const string &file : files){
+            Mat img = imread(file, IMREAD_GRAYSCALE);
+            if(img.empty()) continue;
+            auto t0 = clock::now();
+            Mat edges = houghEdges(img, opts);
+            double cannyMs = chrono::duration<double, milli>(clock::now() - t0).count();
+            if(rank == 0){
+                cout << filesystem::path(file).filename().string() << " (" << img.cols << "x" << img.rows << ", canny "
+                     << cannyMs << " ms)" << endl;
+            }
+            vector<int> reference;
+            double serialMs = 0;
+            for(int b=0; b<BACKEND_COUNT; b++){
+                opts.backend = (HoughBackend)b;
+                vector<int> acc; int nr, nt;
+                double best = 0;
+                for(int k=0; k<repeats; k++){
+                    MPI_Barrier(MPI_COMM_WORLD);
+                    t0 = clock::now();
+                    if(b == BACKEND_MPI || rank == 0) houghTransform(img, edges, acc, nr, nt, opts);
+                    double ms = chrono::duration<double, milli>(clock::now() - t0).count();
+                    if(k == 0 || ms < best) best = ms;
+                }
+                if(rank != 0) continue;
+                if(b == BACKEND_SERIAL){
+                    reference = acc;
+                    serialMs = best;
+                }
+                size_t differing = 0;
+                for(size_t i=0; i<acc.size() && i<reference.size(); i++) differing += acc[i] != reference[i];
+                cout << "  " << backendNames[b] << ": " << best << " ms, speedup " << serialMs/best << "x, ";
+                if(acc.size() == reference.size() && differing == 0) cout << "matches serial" << endl;
+                else cout << "differs from serial in " << differing << " cells" << endl;
             }
         }
-        MPI_Reduce(localAcc.data(), acc.data(), nr*nt, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    }
+
+    static void usage(const char *prog) {
+        cerr << "Usage: " << prog << " [options]\n"
+             << "  -i, --input <image>       input image (default test.png)\n"
+             << "  -o, --output <image>      image with detected lines (default hough_result.png)\n"
+             << "  -b, --backend <name>      serial | threads | fused | mpi (default threads)\n"
+             << "  -t, --threads <n>         worker threads (default 4)\n"
+             << "  --dr <f>, --dth <f>       rho (>= 1 pixel) and theta (degrees) resolution (default 1)\n"
+             << "  --threshold <n>           minimum votes of a line (default 100)\n"
+             << "  --nms <r>, --top <k>      peak suppression radius (default 1) and line limit (default 0, all)\n"
+             << "  --canny <low> <high>      Canny thresholds (default 50 150)\n"
+             << "  --window <deg>            vote only within +-deg of the gradient direction\n"
+             << "  --fixed                   fixed-point rho computation\n"
+             << "  --counters <16|32>        accumulator counter width (default 16, promoted when needed)\n"
+             << "  --split <theta|points>    threads backend work split (default theta)\n"
+             << "  --benchmark [dir]         time all backends on dir/test*.png|jpg (default .)\n"
+             << "  --repeats <n>             benchmark repetitions per backend (default 3)\n"
+             << "  --pipeline <dir|video> [outDir]\n"
+             << "  --bench-generalized <template>  time the R-table transform of template on the input\n"
+             << "  --check                   concurrent houghTransform calls at mixed thread counts match single calls\n"
+             << "  --bench-accumulator | --bench-circles | --progressive" << endl;
     }
 
     int main(int argc, char** argv){
         MPI_Init(&argc,&argv);
         int rank; MPI_Comm_rank(MPI_COMM_WORLD,&rank);
 
-        Mat img = imread("test.png", IMREAD_GRAYSCALE);
+        HoughOptions opts;
+        PeakParams peaks;
+        string input = "test.png", output = "hough_result.png", mode = "lines", modeArg = ".", modeOut = "hough_out";
+        int repeats = 3;
+        bool ok = true;
+        for(int i=1; i<argc && ok; i++){
+            string arg = argv[i];
+            auto next = [&]() -> string {
+                if(i + 1 >= argc){ ok = false; return "0"; }
+                return argv[++i];
+            };
+            auto optional = [&](string &value){
+                if(i + 1 < argc && argv[i+1][0] != '-') value = argv[++i];
+            };
+            if(arg == "-i" || arg == "--input") input = next();
+            else if(arg == "-o" || arg == "--output") output = next();
+            else if(arg == "-b" || arg == "--backend") ok = parseBackend(next(), opts.backend);
+            else if(arg == "-t" || arg == "--threads") opts.numThreads = atoi(next().c_str());
+            else if(arg == "--dr") opts.dr = atof(next().c_str());
+            else if(arg == "--dth") opts.dth = atof(next().c_str());
+            else if(arg == "--threshold") peaks.threshold = atoi(next().c_str());
+            else if(arg == "--nms") peaks.nmsRadius = atoi(next().c_str());
+            else if(arg == "--top") peaks.topK = atoi(next().c_str());
+            else if(arg == "--window") opts.windowDeg = atof(next().c_str());
+            else if(arg == "--fixed") opts.fixedPoint = true;
+            else if(arg == "--repeats") repeats = atoi(next().c_str());
+            else if(arg == "--canny"){
+                opts.cannyLow = atof(next().c_str());
+                opts.cannyHigh = atof(next().c_str());
+            }
+            else if(arg == "--counters"){
+                string w = next();
+                ok = w == "16" || w == "32";
+                opts.width = w == "32" ? COUNTER_32 : COUNTER_16;
+            }
+            else if(arg == "--split"){
+                string split = next();
+                ok = split == "theta" || split == "points";
+                opts.split = split == "points" ? SPLIT_POINTS : SPLIT_THETA;
+            }
+            else if(arg == "--pipeline"){
+                mode = "pipeline";
+                modeArg = next();
+                optional(modeOut);
+            }
+            else if(arg == "--bench-generalized"){
+                mode = "bench-generalized";
+                modeArg = next();
+            }
+            else if(arg == "--benchmark"){
+                mode = "benchmark";
+                optional(modeArg);
+            }
+            else if(arg == "--bench-accumulator" || arg == "--bench-circles" || arg == "--progressive" || arg == "--check") mode = arg.substr(2);
+            else ok = false;
+        }
+        if(!ok || opts.numThreads < 1 || opts.dr < 1 || opts.dth <= 0 || repeats < 1){
+            if(rank == 0) usage(argv[0]);
+            MPI_Finalize();
+            return -1;
+        }
+
+        if(mode == "pipeline"){
+            if(opts.backend == BACKEND_MPI){
+                if(rank == 0) cerr << "--pipeline runs on one rank and does not support the mpi backend" << endl;
+                MPI_Finalize();
+                return -1;
+            }
+            if(rank == 0) runPipeline(modeArg, modeOut, opts, peaks);
+            MPI_Finalize();
+            return 0;
+        }
+
+        if(mode == "benchmark"){
+            runBenchmark(modeArg, opts, repeats);
+            MPI_Finalize();
+            return 0;
+        }
+
+        Mat img = imread(input, IMREAD_GRAYSCALE);
         if(img.empty()){
-            if(rank==0) cerr << "Cannot read test.png" << endl;
+            if(rank==0) cerr << "Cannot read " << input << endl;
             MPI_Finalize();
             return -1;
         }
-        Mat edges; Canny(img, edges, 50, 150);
 
-        vector<int> acc; int nr, nt;
-        houghSerial(edges, acc, nr, nt);
-        houghThreads(edges, acc, nr, nt);
-        houghMPI(edges, acc, nr, nt);
+        if(mode == "check"){
+            int mismatches = rank == 0 ? checkConcurrent(img, opts) : 0;
+            if(rank == 0) cout << "concurrent houghTransform: " << (mismatches ? to_string(mismatches) + " mismatching calls" : "ok") << endl;
+            MPI_Finalize();
+            return mismatches ? 1 : 0;
+        }
 
+        if(mode == "bench-accumulator"){
+            if(rank == 0) benchAccumulator(houghEdges(img, opts));
+            MPI_Finalize();
+            return 0;
+        }
+
+        if(mode == "bench-circles"){
+            if(rank == 0) cout << "Circle benchmark on " << input << " (radii 10..60)" << endl;
+            benchCircles(img, 10, 60, 30, opts);
+            MPI_Finalize();
+            return 0;
+        }
+
+        if(mode == "bench-generalized"){
+            Mat templ = imread(modeArg, IMREAD_GRAYSCALE);
+            if(templ.empty()){
+                if(rank == 0) cerr << "Cannot read " << modeArg << endl;
+                MPI_Finalize();
+                return -1;
+            }
+            if(rank == 0) cout << "Generalized Hough benchmark of " << modeArg << " on " << input << " (scales 0.9..1.1)" << endl;
+            benchGeneralized(img, templ, opts);
+            MPI_Finalize();
+            return 0;
+        }
+
+        if(mode == "progressive"){
+            if(rank == 0){
+                typedef chrono::steady_clock clock;
+                Mat edges = houghEdges(img, opts);
+                ProgressiveParams params;
+                params.peaks = peaks;
+                vector<int> exact, partial; int nr, nt;
+                auto t0 = clock::now();
+                houghSerial(edges, exact, nr, nt, opts.dr, opts.dth, opts.fixedPoint);
+                vector<HoughLine> reference = findPeaks(exact, nr, nt, params.peaks, opts.numThreads, opts.dr, opts.dth);
+                selectTopK(reference, 10);
+                auto t1 = clock::now();
+                vector<HoughLine> lines; ProgressiveStats stats;
+                houghProgressive(edges, partial, nr, nt, lines, params, &stats, opts.numThreads, opts.dr, opts.dth, opts.fixedPoint);
+                auto t2 = clock::now();
+                cout << "Exhaustive: " << chrono::duration<double, milli>(t1 - t0).count() << " ms" << endl;
+                cout << "Progressive: " << chrono::duration<double, milli>(t2 - t1).count() << " ms, voted "
+                     << stats.votedPoints << "/" << stats.totalPoints << " points in " << stats.batches << " batches" << endl;
+                cout << "Top-10 recall vs houghSerial: " << peakRecall(reference, lines, opts.dr, opts.dth) << endl;
+            }
+            MPI_Finalize();
+            return 0;
+        }
+
+        auto t0 = chrono::steady_clock::now();
+        vector<HoughLine> lines = houghLines(img, opts, peaks);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
 
         if(rank == 0){
+            cout << backendNames[opts.backend] << ": " << lines.size() << " lines in " << ms << " ms" << endl;
             Mat color; cvtColor(img, color, COLOR_GRAY2BGR);
-            float dr = 1.f, dth = 1.f;
-            int d = nr/2;
-            for(int r=0; r<nr; r++){
-                for(int t=0; t<nt; t++){
-                    if(acc[r*nt + t] > 100){
-                        float theta = t*dth*CV_PI/180.f;
-                        float rho = (r - d)*dr;
-                        double a = cos(theta), b = sin(theta);
-                        double x0 = a*rho, y0 = b*rho;
-                        Point pt1, pt2;
-                        pt1.x = cvRound(x0 + 1000*(-b));
-                        pt1.y = cvRound(y0 + 1000*(a));
-                        pt2.x = cvRound(x0 - 1000*(-b));
-                        pt2.y = cvRound(y0 - 1000*(a));
-                        line(color, pt1, pt2, Scalar(0, 0, 255), 1, LINE_AA);
-                    }
-                }
-            }
-            imwrite("hough_result.png", color);
-            cout << "Result saved as hough_result.png" << endl;
+            drawLines(color, lines);
+            imwrite(output, color);
+            cout << "Result saved as " << output << endl;
         }
         MPI_Finalize();
         return 0;